@@ -0,0 +1,111 @@
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#include "alloc_count.h"
+
+/* glibc's own allocator, which it exports under these names so that a
+ * replacement malloc() can still reach it */
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void * __libc_valloc(size_t size);
+extern void * __libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+/* relaxed: the counts are only read between the calls being measured */
+static _Atomic uint64_t allocs, frees, bytes;
+
+static void count_alloc(const void *ptr, size_t size) {
+	if (ptr != NULL) {
+		atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+	}
+}
+
+static void count_free(const void *ptr) {
+	if (ptr != NULL) {
+		atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+	}
+}
+
+void alloc_counts(struct alloc_counts *out) {
+	out->allocs = atomic_load_explicit(&allocs, memory_order_relaxed);
+	out->frees = atomic_load_explicit(&frees, memory_order_relaxed);
+	out->bytes = atomic_load_explicit(&bytes, memory_order_relaxed);
+}
+
+void * malloc(size_t size) {
+	void *ptr = __libc_malloc(size);
+	count_alloc(ptr, size);
+	return ptr;
+}
+
+void * calloc(size_t count, size_t size) {
+	void *ptr = __libc_calloc(count, size);
+	count_alloc(ptr, count * size);
+	return ptr;
+}
+
+void * realloc(void *ptr, size_t size) {
+	void *moved = __libc_realloc(ptr, size);
+	/* a realloc() to 0 frees without allocating */
+	if (ptr != NULL && (moved != NULL || size == 0)) {
+		count_free(ptr);
+	}
+	count_alloc(moved, size);
+	return moved;
+}
+
+void * reallocarray(void *ptr, size_t count, size_t size) {
+	/* glibc's own calls its realloc directly, so it would not be counted */
+	size_t total;
+	if (__builtin_mul_overflow(count, size, &total)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, total);
+}
+
+void free(void *ptr) {
+	count_free(ptr);
+	__libc_free(ptr);
+}
+
+void * aligned_alloc(size_t alignment, size_t size) {
+	void *ptr = __libc_memalign(alignment, size);
+	count_alloc(ptr, size);
+	return ptr;
+}
+
+void * memalign(size_t alignment, size_t size) {
+	void *ptr = __libc_memalign(alignment, size);
+	count_alloc(ptr, size);
+	return ptr;
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+	if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+	void *ptr = __libc_memalign(alignment, size);
+	if (ptr == NULL) {
+		return ENOMEM;
+	}
+	count_alloc(ptr, size);
+	*out = ptr;
+	return 0;
+}
+
+void * valloc(size_t size) {
+	void *ptr = __libc_valloc(size);
+	count_alloc(ptr, size);
+	return ptr;
+}
+
+void * pvalloc(size_t size) {
+	void *ptr = __libc_pvalloc(size);
+	count_alloc(ptr, size);
+	return ptr;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <inttypes.h>
+
+/* allocation accounting interface header
+ *
+ * linking alloc_count.c into a program replaces malloc() and the rest of
+ * the allocator with versions that count each call before passing it on to
+ * glibc's, so that calls from inside libc and other libraries are counted
+ * too. malloc(), calloc(), realloc(), reallocarray(), free(),
+ * aligned_alloc(), memalign(), posix_memalign(), valloc() and pvalloc() are
+ * all counted. it is only for debug and bench builds, the game itself never
+ * links it.
+ */
+
+struct alloc_counts {
+	/* calls that returned new memory, reallocations included */
+	uint64_t allocs;
+	/* calls that gave memory back, reallocations included */
+	uint64_t frees;
+	/* the bytes asked for by allocs */
+	uint64_t bytes;
+};
+
+/* the counts since the program started, over every thread */
+void alloc_counts(struct alloc_counts *out);
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* getopt() and close() */
+
+#include "grid.h"
+#include "event_queue.h"
+#include "state.h"
+#include "display.h"
+#include "record.h"
+#include "alloc_count.h"
+
+/* allocs plays recorded games through the engine and the ANSI display,
+ * drawing to /dev/null, and counts the allocations made once the game and
+ * display are set up. it reports them per frame and per piece, and fails
+ * if there were any: the engine and the renderer are meant to reach a
+ * steady state that never touches the allocator, so that it cannot add to
+ * the time a frame takes.
+ *
+ * it is linked with alloc_count.c, which counts every call into the
+ * allocator, see make check-allocs.
+ *
+ * usage: allocs [-n] recording...
+ */
+
+/* the time between frames, as game_loop() draws them */
+#define ALLOCS_FRAME_NS 16666667L
+
+/* what was seen over the frames played */
+struct alloc_report {
+	/* the display drawn on, or NULL */
+	struct display *disp;
+	int64_t frames, pieces;
+	/* the frames that allocated, and the most allocations in one */
+	int64_t dirty_frames;
+	uint64_t worst_frame;
+	struct alloc_counts total;
+};
+
+static void count_piece(void *ctx, const struct game_state *state, const struct tetrimino *piece, int lines) {
+	struct alloc_report *report = (struct alloc_report *) ctx;
+	++report->pieces;
+	if (report->disp != NULL) {
+		display_lock(report->disp, state, piece, lines);
+	}
+}
+
+/* advance the game to now and draw it, if there is a display, counting
+ * what that allocated */
+static void alloc_frame(struct game_state *state, int64_t now, struct alloc_report *report) {
+	struct alloc_counts before, after;
+	alloc_counts(&before);
+	game_advance(state, now);
+	if (report->disp != NULL) {
+		render_state(report->disp, state);
+	}
+	alloc_counts(&after);
+	uint64_t allocs = after.allocs - before.allocs;
+	report->total.allocs += allocs;
+	report->total.frees += after.frees - before.frees;
+	report->total.bytes += after.bytes - before.bytes;
+	report->dirty_frames += allocs > 0;
+	report->worst_frame = allocs > report->worst_frame ? allocs : report->worst_frame;
+	++report->frames;
+}
+
+/* play a recording frame by frame, as replay does. creating and destroying
+ * the game are not part of its steady state, and are left out of the counts */
+static void play_recording(const struct recording *rec, struct alloc_report *report) {
+	struct game_state *state = create_game(rec->seed);
+	if (state == NULL) {
+		error(1, 0, "out of memory");
+	}
+	game_set_autoshift(state, rec->das, rec->arr);
+	game_set_lock_observer(state, count_piece, report);
+	int64_t origin = game_now(state);
+	int64_t frame = origin;
+	for (size_t i = 0; i < rec->count && !game_exiting(state); ++i) {
+		struct game_event event = { .type = rec->events[i].type, .time = origin + rec->events[i].time };
+		for (; frame + ALLOCS_FRAME_NS <= event.time; frame += ALLOCS_FRAME_NS) {
+			alloc_frame(state, frame + ALLOCS_FRAME_NS, report);
+		}
+		/* the input arrives between frames, and is handled by the next */
+		struct alloc_counts before, after;
+		alloc_counts(&before);
+		game_advance(state, event.time);
+		game_push_event(state, event);
+		alloc_counts(&after);
+		report->total.allocs += after.allocs - before.allocs;
+		report->total.frees += after.frees - before.frees;
+		report->total.bytes += after.bytes - before.bytes;
+	}
+	alloc_frame(state, frame + ALLOCS_FRAME_NS, report);
+	destroy_game(state);
+}
+
+int main(int argc, char **argv) {
+	bool draw = true;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n")) != -1) {
+		switch (opt) {
+			case 'n':
+				draw = false;
+				break;
+			default:
+				error(1, 0, "usage: %s [-n] recording...", argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		error(1, 0, "usage: %s [-n] recording...", argv[0]);
+	}
+
+	int fd = -1;
+	struct display *disp = NULL;
+	if (draw) {
+		if ((fd = open("/dev/null", O_WRONLY)) < 0) {
+			error(1, errno, "could not open /dev/null");
+		}
+		if ((disp = create_ansi_display(-1, fd, GRID_WIDTH, GRID_VISIBLE_HEIGHT)) == NULL) {
+			error(1, 0, "could not create the ANSI display");
+		}
+	}
+
+	bool clean = true;
+	for (int i = optind; i < argc; ++i) {
+		struct recording *rec = load_recording(argv[i]);
+		if (rec == NULL) {
+			error(1, errno, "could not read %s", argv[i]);
+		}
+		struct alloc_report report = { .disp = disp };
+		play_recording(rec, &report);
+		printf("%s: %" PRId64 " frames, %" PRId64 " pieces, %" PRIu64 " allocations of %" PRIu64 " bytes, %" PRIu64 " frees, "
+				"%.3f per frame, %.3f per piece, %" PRId64 " frames allocated, at most %" PRIu64 "\n",
+				argv[i], report.frames, report.pieces, report.total.allocs, report.total.bytes, report.total.frees,
+				report.frames > 0 ? (double) report.total.allocs / report.frames : 0.0,
+				report.pieces > 0 ? (double) report.total.allocs / report.pieces : 0.0,
+				report.dirty_frames, report.worst_frame);
+		clean = clean && report.total.allocs == 0 && report.total.frees == 0;
+		destroy_recording(rec);
+	}
+
+	destroy_display(disp);
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (!clean) {
+		fprintf(stderr, "%s: the steady state allocated\n", argv[0]);
+	}
+	return clean ? 0 : 1;
+}
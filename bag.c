@@ -1,41 +1,57 @@
-#include <stdlib.h> /* random functions */
-#include <error.h>
+#include <string.h> /* memmove */
 
 #include "bag.h"
 #include "tetrimino.h"
 
 // BAG IMPL //
-struct tetris_bag {
-	/* stores the random state as used by initstate_r */
-	char random_state[256];
-	/* stores the random data as used by random_r functions */
-  struct random_data random_data_buf;
-	/* the 14 next items in the bag, realized */
-	enum tetrimino_type realized[14];
-};
 
-struct tetris_bag* create_bag(unsigned int seed) {
-	struct tetris_bag *bag = (struct tetris_bag *) malloc(sizeof(struct tetris_bag));
-	bag->random_data_buf.state = NULL;
-	if (initstate_r(seed, bag->random_state, 256, &bag->random_data_buf) != 0) {
-		error(1, 0, "could not initialize bag random state");
-	}
-	return bag;
+/* advance the xorshift64* generator */
+static uint64_t bag_random(struct tetris_bag *bag) {
+	uint64_t x = bag->random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	bag->random_state = x;
+	return x * 0x2545f4914f6cdd1dULL;
 }
 
-void destroy_bag(struct tetris_bag *bag) {
-	if (bag != NULL) {
-		free(bag);
+/* deal a freshly shuffled set of 7 into realized[7..13] */
+static void bag_refill(struct tetris_bag *bag) {
+	uint8_t *set = bag->realized + 7;
+	for (uint8_t i = 0; i < 7; ++i) {
+		set[i] = i;
+	}
+	for (int i = 6; i > 0; --i) {
+		int j = (int) ((bag_random(bag) >> 32) % (i + 1));
+		uint8_t tmp = set[i];
+		set[i] = set[j];
+		set[j] = tmp;
 	}
 }
 
+void bag_init(struct tetris_bag *bag, unsigned int seed) {
+	/* splitmix64 the seed so that nearby seeds give unrelated games */
+	uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	bag->random_state = z != 0 ? z : 1;
+	bag_refill(bag);
+	memmove(bag->realized, bag->realized + 7, 7);
+	bag_refill(bag);
+	bag->next = 0;
+}
+
 enum tetrimino_type bag_peek(const struct tetris_bag *bag, unsigned int n) {
-	// TODO: actually randomize what we peek
-	return TT_I;
+	return (enum tetrimino_type) bag->realized[bag->next + n];
 }
 
 enum tetrimino_type bag_pull(struct tetris_bag *bag) {
-	int32_t rand_val;
-	random_r(&bag->random_data_buf, &rand_val);
-	return (enum tetrimino_type) (rand_val % 7);
+	enum tetrimino_type type = (enum tetrimino_type) bag->realized[bag->next++];
+	if (bag->next == 7) {
+		memmove(bag->realized, bag->realized + 7, 7);
+		bag_refill(bag);
+		bag->next = 0;
+	}
+	return type;
 }
@@ -1,13 +1,24 @@
 #pragma once
 
+#include <inttypes.h>
+
 enum tetrimino_type;
 
-/* a bag is a randomizer for tetris pieces */
-struct tetris_bag;
+/* a bag is a randomizer for tetris pieces. it deals each of the 7
+ * tetriminos once, in a random order, before starting over.
+ * the bag is small and self-contained so that it can live inside a game */
+struct tetris_bag {
+	/* the xorshift64* state of the shuffler, never zero */
+	uint64_t random_state;
+	/* the current bag followed by the next one, as enum tetrimino_type */
+	uint8_t realized[14];
+	/* the index in realized of the next piece to pull */
+	uint8_t next;
+};
 
 /* initialize a new bag */
-struct tetris_bag * create_bag(unsigned int seed);
-void destroy_bag(struct tetris_bag *);
+void bag_init(struct tetris_bag *, unsigned int seed);
 
+/* the nth piece after the next one to be pulled, n must be less than 7 */
 enum tetrimino_type bag_peek(const struct tetris_bag *, unsigned int n);
 enum tetrimino_type bag_pull(struct tetris_bag *);
@@ -0,0 +1,92 @@
+#include <stdbool.h>
+
+#include "bot.h"
+#include "bag.h"
+#include "placement.h"
+#include "grid_features.h"
+
+const struct bot_weights BOT_DEFAULT_WEIGHTS = { .w = {
+	[BF_HEIGHT] = -0.510066,
+	[BF_LINES] = 0.760666,
+	[BF_HOLES] = -0.35663,
+	[BF_BUMPINESS] = -0.184483,
+	[BF_WELLS] = 0.0,
+} };
+
+/* the bot's features from the grid's, with delta the change a move makes */
+static void bot_from_grid(const struct grid_features *gf, const int *delta, double *features) {
+	features[BF_HEIGHT] = gf->totals[GF_HEIGHT] + delta[GF_HEIGHT];
+	features[BF_LINES] = delta[GF_LINES];
+	features[BF_HOLES] = gf->totals[GF_HOLES] + delta[GF_HOLES];
+	features[BF_BUMPINESS] = gf->totals[GF_BUMPINESS] + delta[GF_BUMPINESS];
+	features[BF_WELLS] = gf->totals[GF_WELLS] + delta[GF_WELLS];
+}
+
+static double bot_score(const double *features, const struct bot_weights *weights) {
+	double score = 0;
+	for (int i = 0; i < BF_COUNT; ++i) {
+		score += weights->w[i] * features[i];
+	}
+	return score;
+}
+
+void bot_features(const struct tetris_grid *grid, int lines, double *features) {
+	struct grid_features gf;
+	gf_init(&gf, grid);
+	int delta[GF_COUNT] = { [GF_LINES] = lines };
+	bot_from_grid(&gf, delta, features);
+}
+
+double bot_evaluate(const struct tetris_grid *grid, int lines, const struct bot_weights *weights) {
+	double features[BF_COUNT];
+	bot_features(grid, lines, features);
+	return bot_score(features, weights);
+}
+
+/* the best move for a piece on a grid whose features are gf */
+static bool choose(const struct tetris_grid *grid, const struct grid_features *gf, enum tetrimino_type type,
+		const struct bot_weights *weights, struct move *out) {
+	struct move moves[MAX_MOVES];
+	int count = generate_moves(grid, type, moves);
+	if (count == 0) {
+		return false;
+	}
+	double best_score = 0;
+	for (int i = 0; i < count; ++i) {
+		int delta[GF_COUNT];
+		double features[BF_COUNT];
+		gf_delta(gf, &moves[i].piece, delta);
+		bot_from_grid(gf, delta, features);
+		double score = bot_score(features, weights);
+		if (i == 0 || score > best_score) {
+			best_score = score;
+			*out = moves[i];
+		}
+	}
+	return true;
+}
+
+bool bot_choose(const struct tetris_grid *grid, enum tetrimino_type type, const struct bot_weights *weights, struct move *out) {
+	struct grid_features gf;
+	gf_init(&gf, grid);
+	return choose(grid, &gf, type, weights, out);
+}
+
+int64_t bot_play(const struct bot_weights *weights, unsigned int seed, int max_pieces) {
+	struct tetris_grid grid;
+	struct grid_features gf;
+	struct tetris_bag bag;
+	struct move move;
+	tg_clear(&grid);
+	gf_init(&gf, &grid);
+	bag_init(&bag, seed);
+	for (int i = 0; i < max_pieces; ++i) {
+		if (!choose(&grid, &gf, bag_pull(&bag), weights, &move)) {
+			break;
+		}
+		lockdown(&grid, move.piece);
+		tg_clear_lines(&grid);
+		gf_lock(&gf, &move.piece);
+	}
+	return gf.totals[GF_LINES];
+}
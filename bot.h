@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "grid.h"
+#include "tetrimino.h"
+#include "movegen.h"
+
+/* autoplayer interface header
+ *
+ * the bot scores the board each move would leave with a weighted sum of
+ * features and plays the best one. it plays on a bare grid, without the
+ * engine's timers, so a game runs as fast as moves can be generated
+ */
+
+/* the board features the bot weighs */
+enum bot_feature {
+	BF_HEIGHT = 0, /* the sum of the column heights */
+	BF_LINES, /* the lines the move clears */
+	BF_HOLES, /* the empty cells with a filled cell above */
+	BF_BUMPINESS, /* the sum of the height differences of neighbouring columns */
+	BF_WELLS, /* the sum of the depths of one column wide wells */
+	BF_COUNT
+};
+
+struct bot_weights {
+	double w[BF_COUNT];
+};
+
+/* weights that play reasonably, a starting point for tuning */
+extern const struct bot_weights BOT_DEFAULT_WEIGHTS;
+
+/* the features of a grid after lines were cleared */
+void bot_features(const struct tetris_grid *grid, int lines, double *features);
+
+/* the score of a grid after lines were cleared, higher is better */
+double bot_evaluate(const struct tetris_grid *grid, int lines, const struct bot_weights *);
+
+/* the best move for a piece, or false if it cannot spawn */
+bool bot_choose(const struct tetris_grid *grid, enum tetrimino_type type, const struct bot_weights *, struct move *out);
+
+/**
+ * bot_play
+ * plays a game dealt from seed, as the game with that seed would deal it,
+ * until the bot tops out or has placed max_pieces
+ * returns the lines cleared
+ */
+int64_t bot_play(const struct bot_weights *, unsigned int seed, int max_pieces);
@@ -0,0 +1,327 @@
+#include <stdlib.h> /* malloc() and free() */
+#include <string.h> /* memcpy() and memset() */
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <assert.h> /* static_assert */
+#include <errno.h>
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* pwrite() and close() */
+#include <pthread.h>
+#include <sys/mman.h> /* mmap() */
+#include <sys/stat.h> /* fstat() */
+#include <zlib.h>
+
+#include "dataset.h"
+
+static_assert(sizeof(struct placement) == 4, "placements must stay 4 bytes");
+static_assert(sizeof(struct dataset_header) % 8 == 0, "the header must not need padding");
+static_assert(sizeof(struct dataset_header) <= DATASET_ALIGN, "the first block goes after the header");
+static_assert(GRID_WIDTH <= 255 && GRID_HEIGHT <= 255, "the header holds the board size in bytes");
+
+const uint32_t DATASET_WIDTHS[DC_COUNT] = {
+	[DC_BOARD] = sizeof(uint16_t) * GRID_HEIGHT,
+	[DC_PIECE] = sizeof(uint8_t),
+	[DC_NEXT] = sizeof(uint8_t) * DATASET_NEXT,
+	[DC_PLACEMENT] = sizeof(struct placement),
+	[DC_LINES] = sizeof(uint8_t),
+	[DC_GAME_LINES] = sizeof(uint32_t),
+	[DC_TOPPED_OUT] = sizeof(uint8_t),
+	[DC_SEED] = sizeof(uint32_t),
+};
+
+/* round up to the next block boundary */
+static uint64_t align_block(uint64_t offset) {
+	return (offset + DATASET_ALIGN - 1) & ~(uint64_t) (DATASET_ALIGN - 1);
+}
+
+/* chunks are placed by bumping the end of the file, so writers never wait
+ * on each other to write one. only the index is under the lock, and it is
+ * only written out when the dataset is destroyed */
+struct dataset {
+	int fd;
+	int level;
+	_Atomic uint64_t end;
+	atomic_bool failed;
+	pthread_mutex_t lock;
+	struct dataset_chunk *index;
+	size_t chunks, capacity;
+	uint64_t records;
+};
+
+struct dataset_writer {
+	struct dataset *dataset;
+	size_t count;
+	/* the chunk in progress, a column at a time */
+	uint8_t *columns[DC_COUNT];
+	/* where a full chunk is compressed and laid out for writing */
+	uint8_t *staging;
+	size_t staging_size;
+};
+
+/* write all of buf at offset, retrying partial writes */
+static bool write_at(int fd, const void *buf, size_t size, uint64_t offset) {
+	const uint8_t *bytes = (const uint8_t *) buf;
+	while (size > 0) {
+		ssize_t written = pwrite(fd, bytes, size, (off_t) offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		bytes += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+struct dataset * create_dataset(const char *path, int level) {
+	struct dataset *ds = (struct dataset *) malloc(sizeof(struct dataset));
+	if (ds == NULL) {
+		return NULL;
+	}
+	if ((ds->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+		free(ds);
+		return NULL;
+	}
+	struct dataset_header header = {
+		.magic = DATASET_MAGIC,
+		.version = DATASET_VERSION,
+		.columns = DC_COUNT,
+		.grid_width = GRID_WIDTH,
+		.grid_height = GRID_HEIGHT,
+		.next_count = DATASET_NEXT,
+		.chunk_records = DATASET_CHUNK_RECORDS,
+	};
+	memcpy(header.widths, DATASET_WIDTHS, sizeof(header.widths));
+	if (!write_at(ds->fd, &header, sizeof(header), 0)) {
+		close(ds->fd);
+		free(ds);
+		return NULL;
+	}
+	ds->level = level;
+	atomic_init(&ds->end, align_block(sizeof(header)));
+	atomic_init(&ds->failed, false);
+	pthread_mutex_init(&ds->lock, NULL);
+	ds->index = NULL;
+	ds->chunks = ds->capacity = 0;
+	ds->records = 0;
+	return ds;
+}
+
+bool destroy_dataset(struct dataset *ds) {
+	if (ds == NULL) {
+		return true;
+	}
+	uint64_t index_offset = atomic_load(&ds->end);
+	struct dataset_trailer trailer = {
+		.index_offset = index_offset,
+		.chunks = ds->chunks,
+		.records = ds->records,
+		.magic = DATASET_MAGIC,
+	};
+	size_t index_size = ds->chunks * sizeof(struct dataset_chunk);
+	bool ok = !atomic_load(&ds->failed)
+		&& write_at(ds->fd, ds->index, index_size, index_offset)
+		&& write_at(ds->fd, &trailer, sizeof(trailer), index_offset + index_size);
+	ok = close(ds->fd) == 0 && ok;
+	pthread_mutex_destroy(&ds->lock);
+	free(ds->index);
+	free(ds);
+	return ok;
+}
+
+/* add a written chunk to the index */
+static bool dataset_add_chunk(struct dataset *ds, const struct dataset_chunk *chunk) {
+	pthread_mutex_lock(&ds->lock);
+	if (ds->chunks == ds->capacity) {
+		size_t capacity = ds->capacity == 0 ? 64 : ds->capacity * 2;
+		struct dataset_chunk *index = (struct dataset_chunk *) realloc(ds->index, capacity * sizeof(struct dataset_chunk));
+		if (index == NULL) {
+			pthread_mutex_unlock(&ds->lock);
+			return false;
+		}
+		ds->index = index;
+		ds->capacity = capacity;
+	}
+	ds->index[ds->chunks++] = *chunk;
+	ds->records += chunk->records;
+	pthread_mutex_unlock(&ds->lock);
+	return true;
+}
+
+struct dataset_writer * create_dataset_writer(struct dataset *ds) {
+	struct dataset_writer *writer = (struct dataset_writer *) calloc(1, sizeof(struct dataset_writer));
+	if (writer == NULL) {
+		return NULL;
+	}
+	writer->dataset = ds;
+	bool ok = true;
+	for (int c = 0; c < DC_COUNT; ++c) {
+		size_t raw = (size_t) DATASET_WIDTHS[c] * DATASET_CHUNK_RECORDS;
+		writer->columns[c] = (uint8_t *) malloc(raw);
+		ok = ok && writer->columns[c] != NULL;
+		/* room for the column compressed, which deflate can grow a little */
+		writer->staging_size += align_block(compressBound(raw));
+	}
+	writer->staging = (uint8_t *) malloc(writer->staging_size);
+	if (!ok || writer->staging == NULL) {
+		writer->count = 0;
+		destroy_dataset_writer(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+/* compress and write out the chunk in progress */
+static void dataset_flush(struct dataset_writer *writer) {
+	struct dataset *ds = writer->dataset;
+	if (writer->count == 0) {
+		return;
+	}
+	struct dataset_chunk chunk = { .records = (uint32_t) writer->count };
+	/* lay the blocks out in staging as they will be in the file */
+	uint64_t size = 0;
+	for (int c = 0; c < DC_COUNT; ++c) {
+		size_t raw = (size_t) DATASET_WIDTHS[c] * writer->count;
+		uint8_t *block = writer->staging + size;
+		uLongf packed = compressBound(raw);
+		if (ds->level > 0 && compress2(block, &packed, writer->columns[c], raw, ds->level) == Z_OK && packed < raw) {
+			chunk.blocks[c] = (struct dataset_block) { .offset = size, .size = (uint32_t) packed, .codec = DS_DEFLATE };
+		} else {
+			/* not worth it, readers can use it where it lies */
+			memcpy(block, writer->columns[c], raw);
+			chunk.blocks[c] = (struct dataset_block) { .offset = size, .size = (uint32_t) raw, .codec = DS_RAW };
+		}
+		uint64_t padded = align_block(chunk.blocks[c].size);
+		memset(block + chunk.blocks[c].size, 0, padded - chunk.blocks[c].size);
+		size += padded;
+	}
+
+	uint64_t offset = atomic_fetch_add(&ds->end, size);
+	for (int c = 0; c < DC_COUNT; ++c) {
+		chunk.blocks[c].offset += offset;
+	}
+	if (!write_at(ds->fd, writer->staging, size, offset) || !dataset_add_chunk(ds, &chunk)) {
+		atomic_store(&ds->failed, true);
+	}
+	writer->count = 0;
+}
+
+void destroy_dataset_writer(struct dataset_writer *writer) {
+	if (writer == NULL) {
+		return;
+	}
+	dataset_flush(writer);
+	for (int c = 0; c < DC_COUNT; ++c) {
+		free(writer->columns[c]);
+	}
+	free(writer->staging);
+	free(writer);
+}
+
+void dataset_write(struct dataset_writer *writer, const struct dataset_record *record) {
+	size_t i = writer->count;
+	memcpy(writer->columns[DC_BOARD] + i * DATASET_WIDTHS[DC_BOARD], record->board, sizeof(record->board));
+	writer->columns[DC_PIECE][i] = record->piece;
+	memcpy(writer->columns[DC_NEXT] + i * DATASET_NEXT, record->next, DATASET_NEXT);
+	memcpy(writer->columns[DC_PLACEMENT] + i * sizeof(struct placement), &record->placement, sizeof(struct placement));
+	writer->columns[DC_LINES][i] = record->lines;
+	memcpy(writer->columns[DC_GAME_LINES] + i * sizeof(uint32_t), &record->game_lines, sizeof(uint32_t));
+	writer->columns[DC_TOPPED_OUT][i] = record->topped_out;
+	memcpy(writer->columns[DC_SEED] + i * sizeof(uint32_t), &record->seed, sizeof(uint32_t));
+	if (++writer->count == DATASET_CHUNK_RECORDS) {
+		dataset_flush(writer);
+	}
+}
+
+/* true if every block of the chunk lies within the data region */
+static bool chunk_in_bounds(const struct dataset_chunk *chunk, uint64_t data_end) {
+	if (chunk->records > DATASET_CHUNK_RECORDS) {
+		return false;
+	}
+	for (int c = 0; c < DC_COUNT; ++c) {
+		const struct dataset_block *block = &chunk->blocks[c];
+		if (block->offset % DATASET_ALIGN != 0 || block->offset > data_end || block->size > data_end - block->offset) {
+			return false;
+		}
+		if (block->codec == DS_RAW && block->size != (uint64_t) chunk->records * DATASET_WIDTHS[c]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct dataset_file * open_dataset(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct dataset_header) + sizeof(struct dataset_trailer)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	struct dataset_file *file = (struct dataset_file *) malloc(sizeof(struct dataset_file));
+	if (file == NULL) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	file->map = (const uint8_t *) map;
+	file->size = st.st_size;
+	file->header = (const struct dataset_header *) map;
+
+	const struct dataset_header *header = file->header;
+	const struct dataset_trailer *trailer = (const struct dataset_trailer *) (file->map + file->size - sizeof(struct dataset_trailer));
+	bool ok = header->magic == DATASET_MAGIC && header->version == DATASET_VERSION
+		&& header->columns == DC_COUNT && memcmp(header->widths, DATASET_WIDTHS, sizeof(header->widths)) == 0
+		&& header->grid_width == GRID_WIDTH && header->grid_height == GRID_HEIGHT
+		&& header->next_count == DATASET_NEXT && header->chunk_records == DATASET_CHUNK_RECORDS
+		&& trailer->magic == DATASET_MAGIC && trailer->index_offset % DATASET_ALIGN == 0
+		&& trailer->index_offset <= file->size - sizeof(struct dataset_trailer)
+		&& trailer->chunks == (file->size - sizeof(struct dataset_trailer) - trailer->index_offset) / sizeof(struct dataset_chunk);
+	if (ok) {
+		file->chunks = (const struct dataset_chunk *) (file->map + trailer->index_offset);
+		file->chunk_count = trailer->chunks;
+		file->records = trailer->records;
+		for (uint64_t i = 0; ok && i < file->chunk_count; ++i) {
+			ok = chunk_in_bounds(&file->chunks[i], trailer->index_offset);
+		}
+	}
+	if (!ok) {
+		close_dataset(file);
+		errno = EINVAL;
+		return NULL;
+	}
+	return file;
+}
+
+void close_dataset(struct dataset_file *file) {
+	if (file == NULL) {
+		return;
+	}
+	munmap((void *) file->map, file->size);
+	free(file);
+}
+
+const void * dataset_column(const struct dataset_file *file, uint64_t chunk, enum dataset_column column, void *buf) {
+	const struct dataset_chunk *entry = &file->chunks[chunk];
+	const struct dataset_block *block = &entry->blocks[column];
+	if (block->codec == DS_RAW) {
+		return file->map + block->offset;
+	}
+	uLongf size = (uLongf) entry->records * DATASET_WIDTHS[column];
+	if (block->codec != DS_DEFLATE
+			|| uncompress((Bytef *) buf, &size, file->map + block->offset, block->size) != Z_OK
+			|| size != (uLongf) entry->records * DATASET_WIDTHS[column]) {
+		return NULL;
+	}
+	return buf;
+}
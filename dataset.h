@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "grid.h"
+#include "placement.h" /* struct placement */
+
+/* training dataset interface header
+ *
+ * a dataset holds one fixed-size record per placement: the board the piece
+ * was placed on, the piece and the ones coming after it, where it went, the
+ * lines that cleared, and how the game it was in ended.
+ *
+ * records are written in chunks of up to DATASET_CHUNK_RECORDS, and a chunk
+ * is stored a column at a time, each column compressed on its own, so that
+ * a reader can load only the columns it trains on. every column block
+ * starts on a DATASET_ALIGN boundary, and one stored raw can be used in
+ * place from a mapping of the file as an array of its values.
+ *
+ *   struct dataset_header
+ *   column blocks, chunk after chunk
+ *   struct dataset_chunk for every chunk, in the order they were written
+ *   struct dataset_trailer
+ *
+ * everything is in the byte order of the machine that wrote it. chunks are
+ * in no particular order, and neither are the games within them, but the
+ * records of one game are always consecutive within one writer's chunks.
+ *
+ * each thread producing records has its own struct dataset_writer, which
+ * compresses and writes its chunks itself: writers only ever wait on each
+ * other to add a chunk to the index.
+ */
+
+/* identifies a dataset file ("tetrdat1") */
+#define DATASET_MAGIC 0x3174616472746574ULL
+/* bumped whenever the layout below changes */
+#define DATASET_VERSION 1
+/* the most records in a chunk */
+#define DATASET_CHUNK_RECORDS 16384
+/* the alignment of every column block */
+#define DATASET_ALIGN 64
+/* the upcoming pieces recorded */
+#define DATASET_NEXT 5
+
+/* the columns, in the order they are stored in a chunk */
+enum dataset_column {
+	DC_BOARD = 0, /* uint16_t[GRID_HEIGHT], the rows before the piece locked */
+	DC_PIECE, /* uint8_t, the enum tetrimino_type placed */
+	DC_NEXT, /* uint8_t[DATASET_NEXT], the pieces after it, as bag_peek() deals them */
+	DC_PLACEMENT, /* struct placement, where the piece locked */
+	DC_LINES, /* uint8_t, the lines the placement cleared */
+	DC_GAME_LINES, /* uint32_t, the lines cleared over the whole game */
+	DC_TOPPED_OUT, /* uint8_t, 1 if the game ended by topping out */
+	DC_SEED, /* uint32_t, the seed the game was dealt from */
+	DC_COUNT
+};
+
+/* how column blocks are stored */
+enum dataset_codec {
+	DS_RAW = 0, /* as is */
+	DS_DEFLATE, /* as a zlib stream */
+};
+
+/* one record, as producers hand it over */
+struct dataset_record {
+	uint16_t board[GRID_HEIGHT];
+	uint8_t piece;
+	uint8_t next[DATASET_NEXT];
+	struct placement placement;
+	uint8_t lines;
+	uint32_t game_lines;
+	uint8_t topped_out;
+	uint32_t seed;
+};
+
+struct dataset_header {
+	uint64_t magic;
+	uint32_t version;
+	/* DC_COUNT, and the width in bytes of one value of each column */
+	uint32_t columns;
+	uint32_t widths[DC_COUNT];
+	/* the board the records come from */
+	uint8_t grid_width, grid_height, next_count, _reserved;
+	uint32_t chunk_records;
+};
+
+/* where one column of a chunk is */
+struct dataset_block {
+	uint64_t offset;
+	/* the bytes stored, which is the chunk's records times the column's
+	 * width when raw */
+	uint32_t size;
+	/* the enum dataset_codec */
+	uint32_t codec;
+};
+
+struct dataset_chunk {
+	uint32_t records;
+	uint32_t _reserved;
+	struct dataset_block blocks[DC_COUNT];
+};
+
+struct dataset_trailer {
+	/* where the struct dataset_chunks start, and how many there are */
+	uint64_t index_offset;
+	uint64_t chunks;
+	uint64_t records;
+	uint64_t magic;
+};
+
+/* the width in bytes of one value of each column */
+extern const uint32_t DATASET_WIDTHS[DC_COUNT];
+
+/* a dataset being written, shared by its writers */
+struct dataset;
+/* one thread's chunk in progress */
+struct dataset_writer;
+
+/* create the file at path, compressing at the given zlib level, 0 storing
+ * every column raw. returns NULL on failure */
+struct dataset * create_dataset(const char *path, int level);
+/* write the index and close the file. every writer must be destroyed first.
+ * returns false if anything could not be written */
+bool destroy_dataset(struct dataset *);
+
+/* returns NULL if out of memory */
+struct dataset_writer * create_dataset_writer(struct dataset *);
+/* write out the chunk in progress, however full, and free the writer */
+void destroy_dataset_writer(struct dataset_writer *);
+
+/* add a record, writing out the chunk if that fills it */
+void dataset_write(struct dataset_writer *, const struct dataset_record *record);
+
+/* a dataset mapped for reading */
+struct dataset_file {
+	const uint8_t *map;
+	size_t size;
+	const struct dataset_header *header;
+	const struct dataset_chunk *chunks;
+	uint64_t chunk_count;
+	uint64_t records;
+};
+
+/* map the file at path and check it, returns NULL if it is not a dataset
+ * of this version */
+struct dataset_file * open_dataset(const char *path);
+void close_dataset(struct dataset_file *);
+
+/**
+ * dataset_column
+ * the values of one column of a chunk. a raw column is returned where it
+ * lies in the mapping, and any other is decompressed into buf, which must
+ * hold DATASET_CHUNK_RECORDS values of the column
+ * returns NULL if the block is damaged
+ */
+const void * dataset_column(const struct dataset_file *, uint64_t chunk, enum dataset_column column, void *buf);
@@ -1,15 +1,24 @@
 #include <stdlib.h> /* malloc() and free() */
-#include <curses.h> /* WINDOW definition and most function calls */
+#include <stdbool.h>
+#include <inttypes.h>
 #include <error.h> /* error() */
 
 #include "display.h"
+#include "display_ansi.h"
 #include "tetrimino.h"
+#include "event_queue.h" /* eq_len for the debug overlay */
 #include "state.h" /* render_state definition */
 #include "grid.h" /* render_grid definition */
+#include "placement.h" /* lockdown_colors() */
 
 /* display struct definition */
 
 struct display {
+	/* the raw ANSI backend, or NULL when drawing through ncurses */
+	struct ansi_display *ansi;
+	/* which piece filled each cell, as display_lock() has been told */
+	struct tetris_colors colors;
+#ifndef TERMTRIS_NO_CURSES
 	/* the screen to which the overall game will be rendered */
 	WINDOW *output;
 	/* cache of the width and height of the output screen */
@@ -21,13 +30,30 @@ struct display {
 	WINDOW *hold_stats_win;
 	// TODO: implement stats window WINDOW *hold_stats_win;
 	// TODO: implement hold queue WINDOW *next_queue_win;
+#endif
 };
 
+struct display * create_ansi_display(int in_fd, int out_fd, int grid_width, int grid_height) {
+	struct display *ret = (struct display *)malloc(sizeof(struct display));
+	if (ret == NULL) {
+		return NULL;
+	}
+	if ((ret->ansi = create_ansi_backend(in_fd, out_fd, grid_width, grid_height)) == NULL) {
+		free(ret);
+		return NULL;
+	}
+	tc_clear(&ret->colors);
+	return ret;
+}
+
+#ifndef TERMTRIS_NO_CURSES
 struct display * create_display(WINDOW *out, int grid_width, int grid_height) {
 	struct display *ret = (struct display *)malloc(sizeof(struct display));
 	if (ret == NULL) {
 		return NULL;
 	}
+	ret->ansi = NULL;
+	tc_clear(&ret->colors);
 	ret->output = out;
 	getmaxyx(out, ret->height, ret->width);
 	ret->grid_height = grid_height;
@@ -46,29 +72,83 @@ struct display * create_display(WINDOW *out, int grid_width, int grid_height) {
 
 	return ret;
 }
+#endif
 
 void destroy_display(struct display *disp) {
 	if (disp == NULL) {
 		return;
 	}
-	if (disp->grid_win != NULL) {
+	if (disp->ansi != NULL) {
+		destroy_ansi_backend(disp->ansi);
+	}
+#ifndef TERMTRIS_NO_CURSES
+	else if (disp->grid_win != NULL) {
 		delwin(disp->grid_win);
 	}
+#endif
 	free(disp);
 }
 
+void display_lock(void *ctx, const struct game_state *state, const struct tetrimino *piece, int lines) {
+	struct display *disp = (struct display *) ctx;
+	lockdown_colors(&disp->colors, *piece);
+	/* the grid still holds the lines the piece completed, which the engine
+	 * removes top down before anything is drawn again */
+	const struct tetris_grid *grid = game_grid(state);
+	for (int row = GRID_HEIGHT - 1; row >= 0 && lines > 0; --row) {
+		if (grid->rows[row] == GRID_FULL_ROW) {
+			tc_rmline(&disp->colors, row);
+			--lines;
+		}
+	}
+}
+
+int display_read_key(struct display *disp, int timeout_ms) {
+	if (disp->ansi != NULL) {
+		return ansi_read_key(disp->ansi, timeout_ms);
+	}
+#ifndef TERMTRIS_NO_CURSES
+	wtimeout(disp->output, timeout_ms);
+	return wgetch(disp->output);
+#else
+	return ERR;
+#endif
+}
+
+bool display_key_releases(struct display *disp) {
+	/* ncurses only ever sees key presses */
+	return disp->ansi != NULL && ansi_key_releases(disp->ansi);
+}
+
+#ifndef TERMTRIS_NO_CURSES
+void init_piece_colors(void) {
+	/* the usual guideline colours. orange needs a 256 colour terminal */
+	short orange = COLORS >= 256 ? 208 : COLOR_WHITE;
+	init_pair(DISPLAY_PIECE_PAIR(TT_I), COLOR_CYAN, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_O), COLOR_YELLOW, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_J), COLOR_BLUE, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_L), orange, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_S), COLOR_GREEN, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_Z), COLOR_RED, COLOR_BLACK);
+	init_pair(DISPLAY_PIECE_PAIR(TT_T), COLOR_MAGENTA, COLOR_BLACK);
+}
+
 /* rendering forward declarations */
 void render_pause(WINDOW *win);
-void render_grid(WINDOW* window, const struct tetris_grid *grid);
+void render_grid(WINDOW* window, const struct tetris_grid *grid, const struct tetris_colors *colors);
 void render_borders(struct display *disp);
 void render_piece(struct display *disp, const struct tetrimino *piece);
 
 void render_state(struct display *disp, const struct game_state *state) {
+	if (disp->ansi != NULL) {
+		ansi_render_state(disp->ansi, state, &disp->colors);
+		return;
+	}
 	render_borders(disp);
 	if (game_paused(state)) {
 		render_pause(disp->grid_win);
 	} else {
-		render_grid(disp->grid_win, game_grid(state));
+		render_grid(disp->grid_win, game_grid(state), &disp->colors);
 		render_piece(disp, game_piece(state));
 	}
 	wnoutrefresh(disp->grid_win);
@@ -85,12 +165,12 @@ void render_pause(WINDOW *win) {
 	mvwprintw(win, height/2, 0, " -PAUSED- ");
 }
 
-void render_grid(WINDOW* window, const struct tetris_grid *grid) {
+void render_grid(WINDOW* window, const struct tetris_grid *grid, const struct tetris_colors *colors) {
 	/* repaint cleanly */
 	//clearok(window, TRUE);
 	wmove(window, 0, 0);
 	for (int row = GRID_VISIBLE_HEIGHT-1; row >= 0; --row) {
-		for (int col = 0; col < 10; ++col) {
+		for (int col = 0; col < GRID_WIDTH; ++col) {
 			const char *disp_str;
 			switch (tg_getcell(grid, col, row)) {
 				case GC_EMPTY:
@@ -106,7 +186,15 @@ void render_grid(WINDOW* window, const struct tetris_grid *grid) {
 					error(1, 0, "invalid cell state during render");
 					break;
 			}
+			/* colours are left behind by cleared games, only filled cells have one */
+			unsigned int color = tg_getcell(grid, col, row) != GC_EMPTY ? tc_getcell(colors, col, row) : TC_NONE;
+			if (color != TC_NONE) {
+				wattron(window, COLOR_PAIR(DISPLAY_PIECE_PAIR(color - 1)));
+			}
 			wprintw(window, disp_str); 
+			if (color != TC_NONE) {
+				wattroff(window, COLOR_PAIR(DISPLAY_PIECE_PAIR(color - 1)));
+			}
 		}
 	}
 }
@@ -119,7 +207,9 @@ void render_piece(struct display *disp, const struct tetrimino *piece) {
 		int x = piece->minos[i].x + piece->pos_x;
 		int y = piece->minos[i].y + piece->pos_y;
 		// TODO: test visibility before we attempt outputting it
-		mvwprintw(disp->grid_win, 20-y, x, "█");
+		wattron(disp->grid_win, COLOR_PAIR(DISPLAY_PIECE_PAIR(piece->type)));
+		mvwprintw(disp->grid_win, GRID_VISIBLE_HEIGHT-1-y, x, "█");
+		wattroff(disp->grid_win, COLOR_PAIR(DISPLAY_PIECE_PAIR(piece->type)));
 	}
 }
 
@@ -138,3 +228,29 @@ void render_stats(WINDOW *win, const struct game_state *state) {
 	wprintw(win, "LEVEL   \n%8ld\n", game_level(state));
 	wprintw(win, "LINES   \n%8ld", game_lines_cleared(state));
 }
+
+void render_debug(struct display *disp, const struct game_state *state, int key, int64_t frame_count) {
+	/* the ANSI backend only ever touches the cells of the grid */
+	if (disp->ansi != NULL) {
+		return;
+	}
+	mvwprintw(disp->output, 0, 0, "key: %d\n", key);
+	wprintw(disp->output, "paused: %d\n", game_paused(state));
+	wprintw(disp->output, "frm: %ld\n", frame_count);
+	wprintw(disp->output, "phs: %d\n", (int) game_phase(state));
+	wprintw(disp->output, "qlen: %d\n", eq_len(game_queue(state)));
+	{
+		struct game_event peek;
+		if (eq_peek(game_queue(state), &peek)) {
+			wprintw(disp->output, "event: %d\n", (int) peek.type);
+		}
+	}
+}
+#else
+void render_state(struct display *disp, const struct game_state *state) {
+	ansi_render_state(disp->ansi, state, &disp->colors);
+}
+
+void render_debug(struct display *disp, const struct game_state *state, int key, int64_t frame_count) {
+}
+#endif
@@ -1,14 +1,56 @@
 #pragma once
 
-#include <curses.h> /* for WINDOW type definition */
+#include <stdbool.h>
+#include <inttypes.h>
 
 /* display interface header */
 
 struct display;
 struct game_state;
+struct tetrimino;
+
+#ifndef TERMTRIS_NO_CURSES
+#include <curses.h> /* for WINDOW type definition */
 
 /* returns a new display based off of ncurses' window */
 struct display * create_display(WINDOW *out, int grid_width, int grid_height);
+
+/* the colour pair each tetrimino is drawn with, by enum tetrimino_type */
+#define DISPLAY_PIECE_PAIR(type) (3 + (type))
+
+/* set up the colour pairs the pieces are drawn with, after start_color() */
+void init_piece_colors(void);
+#else
+/* the key codes ncurses would have returned, for builds without it */
+#define ERR (-1)
+#define KEY_DOWN 0402
+#define KEY_UP 0403
+#define KEY_LEFT 0404
+#define KEY_RIGHT 0405
+#endif
+
+/* returns a new display that draws with raw ANSI escape sequences on out_fd
+ * and reads keys from in_fd, or NULL if they are not a terminal. in_fd may
+ * be -1 to draw without reading keys, to any file */
+struct display * create_ansi_display(int in_fd, int out_fd, int grid_width, int grid_height);
 void destroy_display(struct display *disp);
 
 void render_state(struct display *disp, const struct game_state *state);
+
+/* a game_lock_observer, see state.h, keeping the colours the display draws
+ * locked pieces in up to date. ctx is the display. without it every locked
+ * cell is drawn uncoloured */
+void display_lock(void *ctx, const struct game_state *state, const struct tetrimino *piece, int lines);
+
+/* draw engine internals over the screen, if the display has room for them */
+void render_debug(struct display *disp, const struct game_state *state, int key, int64_t frame_count);
+
+/* set on a key code when the key was let go rather than pressed */
+#define DISPLAY_KEY_RELEASED 0x1000000
+
+/* wait up to timeout_ms for a key press, returns ERR if none came */
+int display_read_key(struct display *disp, int timeout_ms);
+
+/* true if the display reports arrow keys being let go, in which case it
+ * does not pass on the terminal's repeats of them either */
+bool display_key_releases(struct display *disp);
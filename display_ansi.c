@@ -0,0 +1,582 @@
+#include <stdlib.h> /* malloc() and free() */
+#include <stdio.h> /* snprintf() */
+#include <stdbool.h>
+#include <string.h> /* memcpy() and memset() */
+#include <errno.h>
+#include <unistd.h> /* read() and write() */
+#include <poll.h> /* poll() */
+#include <signal.h> /* sigaction() and raise() */
+#include <termios.h> /* tcgetattr() and tcsetattr() */
+#include <sys/ioctl.h> /* TIOCGWINSZ */
+
+#include "display.h" /* key codes */
+#include "display_ansi.h"
+#include "tetrimino.h"
+#include "state.h"
+#include "grid.h"
+
+/* what a cell on screen shows. anything else is a printable ASCII character */
+enum ansi_glyph {
+	AG_UNKNOWN = 0, /* not yet drawn */
+	AG_LIGHT, /* ░ */
+	AG_FULL, /* █ */
+	/* from here on pairs of ░ and █ in the colour of each tetrimino_type,
+	 * see ansi_colored(). they stay below the printable characters */
+	AG_COLORED,
+};
+
+/* the glyph for a cell of a tetrimino, full or light */
+static uint8_t ansi_colored(enum tetrimino_type type, bool full) {
+	return AG_COLORED + type * 2 + (full ? 1 : 0);
+}
+
+/* the foreground colour escape sequences, by enum tetrimino_type, and the
+ * one putting back the terminal's own. orange is only in the 256 colour
+ * palette, which terminals without it approximate */
+static const char *const ANSI_PIECE_COLORS[] = {
+	"\x1b[36m", "\x1b[33m", "\x1b[34m", "\x1b[38;5;208m", "\x1b[32m", "\x1b[31m", "\x1b[35m",
+};
+#define ANSI_DEFAULT_COLOR "\x1b[39m"
+/* the longest of those */
+#define ANSI_COLOR_MAX 11
+
+/* the escape sequences bracketing a frame. terminals without synchronized
+ * output ignore the private mode, so it is always safe to send */
+#define ANSI_SYNC_BEGIN "\x1b[?2026h"
+#define ANSI_SYNC_END "\x1b[?2026l"
+
+/* the kitty keyboard protocol: ask for key repeat and release events (flag
+ * 2), ask which flags are in effect, and put things back on the way out.
+ * terminals without the protocol ignore all three, and never answer */
+#define ANSI_KITTY_PUSH "\x1b[>2u"
+#define ANSI_KITTY_QUERY "\x1b[?u"
+#define ANSI_KITTY_POP "\x1b[<u"
+
+struct ansi_display {
+	int in_fd, out_fd;
+	/* the terminal settings to restore on exit, and ours */
+	struct termios saved, raw;
+	/* where the grid sits on screen, 0-based */
+	int grid_width, grid_height;
+	int grid_startx, grid_starty;
+	/* what is currently on screen, and what the next frame should show */
+	uint8_t *shown, *wanted;
+	/* where the terminal's cursor is, or -1 if unknown */
+	int cursor_row, cursor_col;
+	/* the tetrimino_type whose colour the terminal is drawing in, -1 for
+	 * its own colour, or -2 if unknown */
+	int color;
+	/* true until the borders have been drawn */
+	bool fresh;
+	/* the frame being built, preallocated to fit a full redraw */
+	char *buf;
+	size_t len, cap;
+	/* bytes read from the terminal but not yet decoded into keys */
+	uint8_t in[64];
+	size_t in_len;
+	/* true once the terminal has answered the kitty protocol query */
+	bool kitty;
+};
+
+/* the backend that has put the terminal in raw mode, for the signal
+ * handlers and exit() to put it back. only one reads keys at a time */
+static struct ansi_display *volatile ansi_owner;
+/* set while the terminal is given back for a stop, and once it is taken
+ * again so that the next frame repaints everything */
+static volatile sig_atomic_t ansi_stopped, ansi_resumed;
+
+/* the signals handled while a backend has the terminal, and what was
+ * there before */
+static const int ANSI_SIGNALS[] = { SIGINT, SIGTERM, SIGHUP, SIGTSTP, SIGCONT };
+#define ANSI_SIGNAL_COUNT (sizeof(ANSI_SIGNALS) / sizeof(ANSI_SIGNALS[0]))
+static struct sigaction ansi_previous[ANSI_SIGNAL_COUNT];
+
+/* take over the terminal: raw mode, alternate screen, hidden cursor, blank
+ * page and the kitty protocol. async-signal-safe */
+static void ansi_enter(const struct ansi_display *ansi) {
+	static const char enter[] = "\x1b[?1049h\x1b[?25l\x1b[2J";
+	static const char kitty[] = ANSI_KITTY_PUSH ANSI_KITTY_QUERY;
+	if (ansi->in_fd >= 0) {
+		tcsetattr(ansi->in_fd, TCSAFLUSH, &ansi->raw);
+	}
+	write(ansi->out_fd, enter, sizeof(enter) - 1);
+	if (ansi->in_fd >= 0) {
+		write(ansi->out_fd, kitty, sizeof(kitty) - 1);
+	}
+}
+
+/* put the terminal back as it was. async-signal-safe */
+static void ansi_leave(const struct ansi_display *ansi) {
+	static const char leave[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+	if (ansi->in_fd >= 0) {
+		write(ansi->out_fd, ANSI_KITTY_POP, sizeof(ANSI_KITTY_POP) - 1);
+	}
+	write(ansi->out_fd, leave, sizeof(leave) - 1);
+	if (ansi->in_fd >= 0) {
+		tcsetattr(ansi->in_fd, TCSAFLUSH, &ansi->saved);
+	}
+}
+
+/* SIGINT, SIGTERM and SIGHUP: give the terminal back, then die of the
+ * signal with its default action, which SA_RESETHAND has put back */
+static void ansi_on_exit_signal(int sig) {
+	struct ansi_display *ansi = ansi_owner;
+	if (ansi != NULL) {
+		ansi_leave(ansi);
+	}
+	raise(sig);
+}
+
+/* SIGCONT: take the terminal again if it was given back for a stop */
+static void ansi_on_continue(int sig) {
+	int saved_errno = errno;
+	struct ansi_display *ansi = ansi_owner;
+	if (ansi != NULL && ansi_stopped) {
+		ansi_enter(ansi);
+		ansi_stopped = 0;
+	}
+	ansi_resumed = 1;
+	errno = saved_errno;
+}
+
+/* SIGTSTP: give the terminal back and stop for real. once continued,
+ * ansi_on_continue() has taken it again and this handler is put back */
+static void ansi_on_stop(int sig) {
+	int saved_errno = errno;
+	struct ansi_display *ansi = ansi_owner;
+	if (ansi != NULL) {
+		ansi_leave(ansi);
+		ansi_stopped = 1;
+	}
+	struct sigaction action = { .sa_handler = SIG_DFL };
+	struct sigaction handler = { .sa_handler = ansi_on_stop, .sa_flags = SA_RESTART };
+	sigaction(SIGTSTP, &action, NULL);
+	sigset_t unblock;
+	sigemptyset(&unblock);
+	sigaddset(&unblock, SIGTSTP);
+	sigprocmask(SIG_UNBLOCK, &unblock, NULL);
+	raise(SIGTSTP);
+	sigaction(SIGTSTP, &handler, NULL);
+	/* an orphaned process group is not stopped, and gets no SIGCONT */
+	if (ansi != NULL && ansi_stopped) {
+		ansi_on_continue(SIGCONT);
+	}
+	errno = saved_errno;
+}
+
+/* error() and the like exit without destroying the display */
+static void ansi_at_exit(void) {
+	struct ansi_display *ansi = ansi_owner;
+	if (ansi != NULL) {
+		ansi_owner = NULL;
+		ansi_leave(ansi);
+	}
+}
+
+/* route the signals that would leave the terminal raw through handlers
+ * that put it back. signals that were ignored stay ignored */
+static void ansi_take_signals(struct ansi_display *ansi) {
+	static bool registered = false;
+	if (!registered) {
+		atexit(ansi_at_exit);
+		registered = true;
+	}
+	ansi_owner = ansi;
+	for (size_t i = 0; i < ANSI_SIGNAL_COUNT; ++i) {
+		struct sigaction action = { .sa_flags = SA_RESTART };
+		switch (ANSI_SIGNALS[i]) {
+			case SIGTSTP:
+				action.sa_handler = ansi_on_stop;
+				break;
+			case SIGCONT:
+				action.sa_handler = ansi_on_continue;
+				break;
+			default:
+				action.sa_handler = ansi_on_exit_signal;
+				action.sa_flags |= SA_RESETHAND;
+				break;
+		}
+		sigemptyset(&action.sa_mask);
+		sigaction(ANSI_SIGNALS[i], NULL, &ansi_previous[i]);
+		if (ansi_previous[i].sa_handler != SIG_IGN) {
+			sigaction(ANSI_SIGNALS[i], &action, NULL);
+		}
+	}
+}
+
+static void ansi_release_signals(void) {
+	ansi_owner = NULL;
+	for (size_t i = 0; i < ANSI_SIGNAL_COUNT; ++i) {
+		sigaction(ANSI_SIGNALS[i], &ansi_previous[i], NULL);
+	}
+}
+
+struct ansi_display * create_ansi_backend(int in_fd, int out_fd, int grid_width, int grid_height) {
+	/* without input there is no terminal to set up, and output may go anywhere */
+	if (in_fd >= 0 && (!isatty(in_fd) || !isatty(out_fd))) {
+		return NULL;
+	}
+	struct ansi_display *ansi = (struct ansi_display *) malloc(sizeof(struct ansi_display));
+	if (ansi == NULL) {
+		return NULL;
+	}
+	size_t cells = (size_t) grid_width * grid_height;
+	ansi->in_fd = in_fd;
+	ansi->out_fd = out_fd;
+	ansi->grid_width = grid_width;
+	ansi->grid_height = grid_height;
+	ansi->shown = (uint8_t *) malloc(cells);
+	ansi->wanted = (uint8_t *) malloc(cells);
+	/* every cell may need a cursor move, a colour and a 3 byte glyph, plus
+	 * the borders */
+	ansi->cap = cells * (16 + ANSI_COLOR_MAX) + (grid_width + grid_height) * 32 + 256;
+	ansi->buf = (char *) malloc(ansi->cap);
+	if (ansi->shown == NULL || ansi->wanted == NULL || ansi->buf == NULL) {
+		free(ansi->shown);
+		free(ansi->wanted);
+		free(ansi->buf);
+		free(ansi);
+		return NULL;
+	}
+	memset(ansi->shown, AG_UNKNOWN, cells);
+	ansi->len = 0;
+	ansi->in_len = 0;
+	ansi->kitty = false;
+	ansi->cursor_row = ansi->cursor_col = -1;
+	ansi->color = -2;
+	ansi->fresh = true;
+
+	struct winsize size;
+	int rows = 24, cols = 80;
+	if (ioctl(out_fd, TIOCGWINSZ, &size) == 0 && size.ws_row > 0) {
+		rows = size.ws_row;
+		cols = size.ws_col;
+	}
+	ansi->grid_starty = (rows - grid_height) / 2;
+	ansi->grid_startx = (cols - grid_width) / 2;
+
+	/* like cbreak() and noecho(): keys arrive as typed, signals still work
+	 * and, like ncurses', put the terminal back before they take effect */
+	if (in_fd >= 0) {
+		tcgetattr(in_fd, &ansi->saved);
+		ansi->raw = ansi->saved;
+		ansi->raw.c_lflag &= ~(ICANON | ECHO);
+		ansi->raw.c_cc[VMIN] = 1;
+		ansi->raw.c_cc[VTIME] = 0;
+		ansi_take_signals(ansi);
+	}
+	ansi_enter(ansi);
+	return ansi;
+}
+
+void destroy_ansi_backend(struct ansi_display *ansi) {
+	if (ansi == NULL) {
+		return;
+	}
+	if (ansi->in_fd >= 0) {
+		ansi_release_signals();
+	}
+	ansi_leave(ansi);
+	free(ansi->shown);
+	free(ansi->wanted);
+	free(ansi->buf);
+	free(ansi);
+}
+
+/* append bytes to the frame being built */
+static void ansi_put(struct ansi_display *ansi, const char *str, size_t len) {
+	memcpy(ansi->buf + ansi->len, str, len);
+	ansi->len += len;
+}
+
+/* append one character cell, which moves the cursor along by a column */
+static void ansi_put_cell(struct ansi_display *ansi, const char *str, size_t len) {
+	ansi_put(ansi, str, len);
+	if (ansi->cursor_col >= 0) {
+		++ansi->cursor_col;
+	}
+}
+
+/* move the cursor, unless it is already there */
+static void ansi_move(struct ansi_display *ansi, int row, int col) {
+	if (ansi->cursor_row == row && ansi->cursor_col == col) {
+		return;
+	}
+	ansi->len += snprintf(ansi->buf + ansi->len, ansi->cap - ansi->len, "\x1b[%d;%dH", row + 1, col + 1);
+	ansi->cursor_row = row;
+	ansi->cursor_col = col;
+}
+
+/* switch the foreground to a tetrimino_type's colour, or -1 for the default */
+static void ansi_color(struct ansi_display *ansi, int color) {
+	if (ansi->color == color) {
+		return;
+	}
+	const char *sgr = color < 0 ? ANSI_DEFAULT_COLOR : ANSI_PIECE_COLORS[color];
+	ansi_put(ansi, sgr, strlen(sgr));
+	ansi->color = color;
+}
+
+static void ansi_put_glyph(struct ansi_display *ansi, uint8_t glyph) {
+	if (glyph >= AG_COLORED && glyph < ' ') {
+		ansi_color(ansi, (glyph - AG_COLORED) / 2);
+		glyph = (glyph - AG_COLORED) % 2 ? AG_FULL : AG_LIGHT;
+	} else {
+		ansi_color(ansi, -1);
+	}
+	switch (glyph) {
+		case AG_LIGHT:
+			ansi_put_cell(ansi, "░", 3);
+			break;
+		case AG_FULL:
+			ansi_put_cell(ansi, "█", 3);
+			break;
+		default: {
+			char c = (char) glyph;
+			ansi_put_cell(ansi, &c, 1);
+			break;
+		}
+	}
+}
+
+/* draw borders around the grid, which never change */
+static void ansi_borders(struct ansi_display *ansi) {
+	ansi_color(ansi, -1);
+	for (int row = 0; row < ansi->grid_height; ++row) {
+		ansi_move(ansi, ansi->grid_starty + row, ansi->grid_startx - 1);
+		ansi_put_cell(ansi, "|", 1);
+		ansi_move(ansi, ansi->grid_starty + row, ansi->grid_startx + ansi->grid_width);
+		ansi_put_cell(ansi, "|", 1);
+	}
+	ansi_move(ansi, ansi->grid_starty - 1, ansi->grid_startx);
+	for (int col = 0; col < ansi->grid_width; ++col) {
+		ansi_put_cell(ansi, "_", 1);
+	}
+	ansi_move(ansi, ansi->grid_starty + ansi->grid_height, ansi->grid_startx);
+	for (int col = 0; col < ansi->grid_width; ++col) {
+		ansi_put_cell(ansi, "^", 1);
+	}
+}
+
+/* fill the wanted screen from the game, top row first like the ncurses backend */
+static void ansi_compose(struct ansi_display *ansi, const struct game_state *state, const struct tetris_colors *colors) {
+	int width = ansi->grid_width, height = ansi->grid_height;
+	if (game_paused(state)) {
+		static const char paused[] = " -PAUSED- ";
+		memset(ansi->wanted, ' ', (size_t) width * height);
+		for (int col = 0; col < width && paused[col] != '\0'; ++col) {
+			ansi->wanted[(height / 2) * width + col] = (uint8_t) paused[col];
+		}
+		return;
+	}
+	const struct tetris_grid *grid = game_grid(state);
+	for (int row = 0; row < height; ++row) {
+		uint8_t *line = ansi->wanted + (height - 1 - row) * width;
+		for (int col = 0; col < width; ++col) {
+			unsigned int color = tc_getcell(colors, col, row);
+			switch (tg_getcell(grid, col, row)) {
+				case GC_FILL1:
+					line[col] = color != TC_NONE ? ansi_colored(color - 1, false) : AG_LIGHT;
+					break;
+				case GC_FILL2:
+					line[col] = color != TC_NONE ? ansi_colored(color - 1, true) : AG_FULL;
+					break;
+				default:
+					line[col] = ' ';
+					break;
+			}
+		}
+	}
+	const struct tetrimino *piece = game_piece(state);
+	if (piece == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < 4; ++i) {
+		int x = piece->minos[i].x + piece->pos_x;
+		int y = piece->minos[i].y + piece->pos_y;
+		if (x >= 0 && x < width && y >= 0 && y < height) {
+			ansi->wanted[(height - 1 - y) * width + x] = ansi_colored(piece->type, true);
+		}
+	}
+}
+
+void ansi_render_state(struct ansi_display *ansi, const struct game_state *state, const struct tetris_colors *colors) {
+	/* back from a stop the screen was cleared, so everything is drawn again */
+	if (ansi == ansi_owner && ansi_resumed) {
+		ansi_resumed = 0;
+		ansi->fresh = true;
+		memset(ansi->shown, AG_UNKNOWN, (size_t) ansi->grid_width * ansi->grid_height);
+		ansi->cursor_row = ansi->cursor_col = -1;
+		ansi->color = -2;
+	}
+	ansi_compose(ansi, state, colors);
+
+	ansi->len = 0;
+	ansi_put(ansi, ANSI_SYNC_BEGIN, sizeof(ANSI_SYNC_BEGIN) - 1);
+	size_t empty = ansi->len;
+	if (ansi->fresh) {
+		ansi_borders(ansi);
+		ansi->fresh = false;
+	}
+	for (int row = 0; row < ansi->grid_height; ++row) {
+		for (int col = 0; col < ansi->grid_width; ++col) {
+			size_t i = (size_t) row * ansi->grid_width + col;
+			if (ansi->shown[i] != ansi->wanted[i]) {
+				ansi_move(ansi, ansi->grid_starty + row, ansi->grid_startx + col);
+				ansi_put_glyph(ansi, ansi->wanted[i]);
+				ansi->shown[i] = ansi->wanted[i];
+			}
+		}
+	}
+	if (ansi->len == empty) {
+		return; /* nothing changed, nothing to send */
+	}
+	ansi_put(ansi, ANSI_SYNC_END, sizeof(ANSI_SYNC_END) - 1);
+
+	size_t off = 0;
+	while (off < ansi->len) {
+		ssize_t written = write(ansi->out_fd, ansi->buf + off, ansi->len - off);
+		if (written < 0 && errno != EINTR) {
+			/* the screen is in an unknown state now, repaint it all next time */
+			memset(ansi->shown, AG_UNKNOWN, (size_t) ansi->grid_width * ansi->grid_height);
+			ansi->cursor_row = ansi->cursor_col = -1;
+			ansi->color = -2;
+			return;
+		}
+		off += written > 0 ? written : 0;
+	}
+}
+
+/* read a decimal parameter of a control sequence, or fallback if it is empty */
+static int ansi_param(const uint8_t **p, const uint8_t *end, int fallback) {
+	if (*p >= end || **p < '0' || **p > '9') {
+		return fallback;
+	}
+	int value = 0;
+	for (; *p < end && **p >= '0' && **p <= '9'; ++*p) {
+		value = value * 10 + (**p - '0');
+	}
+	return value;
+}
+
+/* the kitty protocol's key event types */
+enum ansi_key_event {
+	AK_PRESS = 1,
+	AK_REPEAT = 2,
+	AK_RELEASE = 3,
+};
+
+/* decode the control sequence with parameters from params to end, returns
+ * ERR if it is not a key or it is one we have no use for */
+static int ansi_decode_sequence(struct ansi_display *ansi, const uint8_t *params, const uint8_t *end, uint8_t final) {
+	/* the answer to the kitty protocol query: CSI ? flags u */
+	if (params < end && *params == '?') {
+		if (final == 'u') {
+			ansi->kitty = true;
+		}
+		return ERR;
+	}
+	/* keys are CSI number ; modifiers : event final, all optional */
+	int number = ansi_param(&params, end, 1);
+	int event = AK_PRESS;
+	if (params < end && *params == ';') {
+		++params;
+		ansi_param(&params, end, 1);
+		if (params < end && *params == ':') {
+			++params;
+			event = ansi_param(&params, end, AK_PRESS);
+		}
+	}
+	int key;
+	switch (final) {
+		case 'A':
+			key = KEY_UP;
+			break;
+		case 'B':
+			key = KEY_DOWN;
+			break;
+		case 'C':
+			key = KEY_RIGHT;
+			break;
+		case 'D':
+			key = KEY_LEFT;
+			break;
+		case 'u':
+			/* any other key, by its unicode codepoint */
+			key = number == '\r' ? '\n' : number;
+			break;
+		default:
+			return ERR;
+	}
+	bool arrow = final != 'u';
+	if (event == AK_RELEASE) {
+		/* only arrow keys can be held down, see event_for_key() */
+		return arrow ? key | DISPLAY_KEY_RELEASED : ERR;
+	}
+	if (event == AK_REPEAT && arrow) {
+		return ERR; /* the engine repeats held arrow keys itself */
+	}
+	return key;
+}
+
+/* ansi_decode_key()'s result when the input buffer ends partway through a
+ * control sequence, the rest of which is still to be read */
+#define ANSI_PARTIAL (-2)
+
+/* decode the key at the start of the input buffer, which must not be empty.
+ * returns ERR, having consumed it, if it is one we have no use for, and
+ * ANSI_PARTIAL, consuming nothing, if it is not all there yet */
+static int ansi_decode_key(struct ansi_display *ansi) {
+	size_t used = 1;
+	int key = ansi->in[0];
+	if (key == 0x1b && (ansi->in_len == 1 || ansi->in[1] == '[' || ansi->in[1] == 'O')) {
+		/* a control sequence runs until its final byte */
+		used = 2;
+		while (used < ansi->in_len && (ansi->in[used] < 0x40 || ansi->in[used] > 0x7e)) {
+			++used;
+		}
+		if (used >= ansi->in_len && ansi->in_len < sizeof(ansi->in)) {
+			return ANSI_PARTIAL;
+		}
+		if (used >= ansi->in_len) {
+			/* one that fills the buffer without ending is thrown away */
+			key = ERR;
+			used = ansi->in_len;
+		} else {
+			key = ansi_decode_sequence(ansi, ansi->in + 2, ansi->in + used, ansi->in[used]);
+			++used;
+		}
+	} else if (key == '\r') {
+		key = '\n';
+	}
+	memmove(ansi->in, ansi->in + used, ansi->in_len - used);
+	ansi->in_len -= used;
+	return key;
+}
+
+int ansi_read_key(struct ansi_display *ansi, int timeout_ms) {
+	for (;;) {
+		/* pass over whatever is buffered that is not a key we want */
+		int key = ERR;
+		while (ansi->in_len > 0 && (key = ansi_decode_key(ansi)) == ERR) {
+		}
+		if (key != ERR && key != ANSI_PARTIAL) {
+			return key;
+		}
+		/* read more after anything kept, only waiting the first time round */
+		struct pollfd pfd = { .fd = ansi->in_fd, .events = POLLIN };
+		if (poll(&pfd, 1, timeout_ms) <= 0) {
+			return ERR;
+		}
+		ssize_t got = read(ansi->in_fd, ansi->in + ansi->in_len, sizeof(ansi->in) - ansi->in_len);
+		if (got <= 0) {
+			return ERR;
+		}
+		ansi->in_len += got;
+		timeout_ms = 0;
+	}
+}
+
+bool ansi_key_releases(const struct ansi_display *ansi) {
+	return ansi->kitty;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* raw ANSI display backend, used through the display interface */
+
+struct ansi_display;
+struct game_state;
+struct tetris_colors;
+
+/* put the terminal on in_fd/out_fd in raw mode and take over the screen.
+ * returns NULL if either is not a terminal. in_fd may be -1 for a display
+ * that only draws, in which case out_fd may be any file. a backend reading
+ * keys gives the terminal back on SIGINT, SIGTERM, SIGHUP and exit(), and
+ * while stopped by SIGTSTP */
+struct ansi_display * create_ansi_backend(int in_fd, int out_fd, int grid_width, int grid_height);
+/* restore the terminal */
+void destroy_ansi_backend(struct ansi_display *);
+
+/* draw a frame with a single write() of only the cells that changed, the
+ * locked cells in the colours given */
+void ansi_render_state(struct ansi_display *, const struct game_state *state, const struct tetris_colors *colors);
+
+/* wait up to timeout_ms for a key, returns ERR if none came. input that is no
+ * key we use is passed over, and a control sequence split across reads is
+ * kept until the rest of it arrives */
+int ansi_read_key(struct ansi_display *, int timeout_ms);
+
+/* true once the terminal has confirmed it speaks the kitty keyboard
+ * protocol, after which arrow key releases are reported */
+bool ansi_key_releases(const struct ansi_display *);
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h> /* getopt() */
+
+#include "dataset.h"
+
+/* dsdump describes a training dataset written by gendata or replay -x,
+ * chunk by chunk, or converts its records to CSV for loading elsewhere.
+ *
+ * usage: dsdump [-c] dataset_file
+ *
+ * in CSV the board is one column of GRID_HEIGHT hexadecimal rows, bottom
+ * first, and the next queue one of piece numbers.
+ */
+
+static const char *CODEC_NAMES[] = { "raw", "deflate" };
+
+static const char * codec_name(uint32_t codec) {
+	return codec < sizeof(CODEC_NAMES) / sizeof(CODEC_NAMES[0]) ? CODEC_NAMES[codec] : "?";
+}
+
+/* print one chunk's records as CSV rows */
+static void print_chunk(const struct dataset_file *file, uint64_t chunk, void **buffers) {
+	const void *columns[DC_COUNT];
+	for (int c = 0; c < DC_COUNT; ++c) {
+		if ((columns[c] = dataset_column(file, chunk, c, buffers[c])) == NULL) {
+			error(1, 0, "chunk %" PRIu64 " is damaged", chunk);
+		}
+	}
+	const uint16_t *boards = (const uint16_t *) columns[DC_BOARD];
+	const uint8_t *next = (const uint8_t *) columns[DC_NEXT];
+	const struct placement *placements = (const struct placement *) columns[DC_PLACEMENT];
+	const uint32_t *game_lines = (const uint32_t *) columns[DC_GAME_LINES];
+	const uint32_t *seeds = (const uint32_t *) columns[DC_SEED];
+	for (uint32_t i = 0; i < file->chunks[chunk].records; ++i) {
+		printf("%" PRIu32 ",", seeds[i]);
+		for (int row = 0; row < GRID_HEIGHT; ++row) {
+			printf("%s%04x", row > 0 ? " " : "", boards[i * GRID_HEIGHT + row]);
+		}
+		printf(",%u,", ((const uint8_t *) columns[DC_PIECE])[i]);
+		for (int n = 0; n < DATASET_NEXT; ++n) {
+			printf("%s%u", n > 0 ? " " : "", next[i * DATASET_NEXT + n]);
+		}
+		printf(",%u,%d,%d,%u,%" PRIu32 ",%u\n", placements[i].rs, placements[i].x, placements[i].y,
+				((const uint8_t *) columns[DC_LINES])[i], game_lines[i],
+				((const uint8_t *) columns[DC_TOPPED_OUT])[i]);
+	}
+}
+
+int main(int argc, char **argv) {
+	bool csv = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "c")) != -1) {
+		switch (opt) {
+			case 'c':
+				csv = true;
+				break;
+			default:
+				error(1, 0, "usage: %s [-c] dataset_file", argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		error(1, 0, "usage: %s [-c] dataset_file", argv[0]);
+	}
+
+	struct dataset_file *file = open_dataset(argv[optind]);
+	if (file == NULL) {
+		error(1, errno, "could not read %s as a %dx%d dataset version %d",
+				argv[optind], GRID_WIDTH, GRID_HEIGHT, DATASET_VERSION);
+	}
+	void *buffers[DC_COUNT];
+	for (int c = 0; c < DC_COUNT; ++c) {
+		if ((buffers[c] = malloc((size_t) DATASET_WIDTHS[c] * DATASET_CHUNK_RECORDS)) == NULL) {
+			error(1, 0, "out of memory");
+		}
+	}
+
+	if (csv) {
+		printf("seed,board,piece,next,rotation,x,y,lines,game_lines,topped_out\n");
+	}
+	for (uint64_t chunk = 0; chunk < file->chunk_count; ++chunk) {
+		if (csv) {
+			print_chunk(file, chunk, buffers);
+			continue;
+		}
+		const struct dataset_chunk *entry = &file->chunks[chunk];
+		printf("chunk %" PRIu64 ": %" PRIu32 " records", chunk, entry->records);
+		for (int c = 0; c < DC_COUNT; ++c) {
+			const struct dataset_block *block = &entry->blocks[c];
+			printf(", %" PRIu32 " %s", block->size, codec_name(block->codec));
+		}
+		printf("\n");
+	}
+	fprintf(stderr, "%" PRIu64 " records in %" PRIu64 " chunks, %zu bytes\n", file->records, file->chunk_count, file->size);
+	for (int c = 0; c < DC_COUNT; ++c) {
+		free(buffers[c]);
+	}
+	close_dataset(file);
+	return 0;
+}
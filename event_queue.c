@@ -1,34 +1,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h> /* memmove */
 
 #include "event_queue.h"
 
-struct event_queue {
-	struct event_queue_node *head;
-};
-
-struct event_queue_node {
-	struct event_queue_node *next;
-	struct game_event event;
-};
-
-/* allocate and create an event queue */
-struct event_queue * create_eq() {
-	struct event_queue *queue = (struct event_queue *) malloc(sizeof(struct event_queue));
-	queue->head = NULL;
-	return queue;
-}
-
-/* destroy and deallocate an event queue */
-void destroy_eq(struct event_queue *queue) {
-	if (queue == NULL) { return; }
-	struct event_queue_node *node = queue->head;
-	while(node != NULL) {
-		node = node->next;
-		free(queue->head);
-		queue->head = node;
-	}
-	free(queue);
+/* initialize an empty event queue */
+void eq_init(struct event_queue *queue) {
+	queue->len = 0;
 }
 
 /**
@@ -38,10 +16,11 @@ void destroy_eq(struct event_queue *queue) {
  * returns true and populates evt otherwise
  */
 bool eq_peek(const struct event_queue *queue, struct game_event *evt) {
-	if (queue == NULL || queue->head == NULL) {
+	if (queue == NULL || queue->len == 0) {
 		return false;
 	}
-	*evt = queue->head->event;
+	evt->type = (enum game_event_type) queue->types[0];
+	evt->time = queue->times[0];
 	return true;
 }
 
@@ -52,35 +31,86 @@ bool eq_peek(const struct event_queue *queue, struct game_event *evt) {
  * returns true and populates evt otherwise
  */
 bool eq_pop(struct event_queue *queue, struct game_event *event) {
-	if (queue == NULL || queue->head == NULL) {
+	if (!eq_peek(queue, event)) {
 		return false;
 	}
-	struct event_queue_node *new_head = queue->head->next;
-	*event = queue->head->event;
-	free(queue->head);
-	queue->head = new_head;
+	--queue->len;
+	memmove(queue->times, queue->times + 1, sizeof(int64_t) * queue->len);
+	memmove(queue->types, queue->types + 1, queue->len);
 	return true;
 }
 
-void eq_push(struct event_queue *queue, struct game_event event) {
-	struct event_queue_node *node = malloc(sizeof(struct event_queue_node));
-	node->event = event;
-	if (queue->head == NULL) {
-		queue->head = node;
-		node->next = NULL;
-	} else if (event.time < queue->head->event.time) {
-		node->next = queue->head;
-		queue->head = node;
-	} else {
-		struct event_queue_node *curr = queue->head->next;
-		struct event_queue_node *prev = queue->head;
-		while (curr != NULL && node->event.time >= curr->event.time) {
-			prev = curr;
-			curr = curr->next;
-		};
-		prev->next = node;
-		node->next = curr;
+bool eq_push(struct event_queue *queue, struct game_event event) {
+	if (queue->len == EQ_CAPACITY) {
+		return false;
+	}
+	/* find the first event that comes strictly later */
+	int i = queue->len;
+	while (i > 0 && queue->times[i - 1] > event.time) {
+		--i;
 	}
+	memmove(queue->times + i + 1, queue->times + i, sizeof(int64_t) * (queue->len - i));
+	memmove(queue->types + i + 1, queue->types + i, queue->len - i);
+	queue->times[i] = event.time;
+	queue->types[i] = (uint8_t) event.type;
+	++queue->len;
+	return true;
+}
+
+/* drop the events whose type does or does not match, keeping the order */
+static void eq_filter(struct event_queue *queue, enum game_event_type type, bool keep) {
+	int kept = 0;
+	for (int i = 0; i < queue->len; ++i) {
+		if ((queue->types[i] == (uint8_t) type) == keep) {
+			queue->times[kept] = queue->times[i];
+			queue->types[kept] = queue->types[i];
+			++kept;
+		}
+	}
+	queue->len = kept;
+}
+
+void eq_remove(struct event_queue *queue, enum game_event_type type) {
+	eq_filter(queue, type, false);
+}
+
+void eq_keep(struct event_queue *queue, enum game_event_type type) {
+	eq_filter(queue, type, true);
+}
+
+/* the names of the events, indexed by enum game_event_type */
+static const char *EVENT_NAMES[] = {
+	[GE_NOOP] = "noop",
+	[GE_PAUSE] = "pause",
+	[GE_LSHIFT] = "lshift",
+	[GE_RSHIFT] = "rshift",
+	[GE_HARDDROP] = "harddrop",
+	[GE_SOFTDROP] = "softdrop",
+	[GE_CWROTATE] = "cwrotate",
+	[GE_CCWROTATE] = "ccwrotate",
+	[GE_QUIT] = "quit",
+	[GE_NEWGAME] = "newgame",
+	[GE_CONTACT] = "contact",
+	[GE_LOCKDOWN] = "lockdown",
+	[GE_GAMEOVER] = "gameover",
+	[GE_ENTER] = "enter",
+	[GE_LPRESS] = "lpress",
+	[GE_RPRESS] = "rpress",
+	[GE_LRELEASE] = "lrelease",
+	[GE_RRELEASE] = "rrelease",
+	[GE_AUTOSHIFT] = "autoshift",
+};
+
+const char * ge_name(enum game_event_type type) {
+	if ((size_t) type >= sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0])) {
+		return NULL;
+	}
+	return EVENT_NAMES[type];
+}
+
+bool ge_is_input(enum game_event_type type) {
+	return (type >= GE_PAUSE && type <= GE_QUIT) ||
+		(type >= GE_LPRESS && type <= GE_RRELEASE);
 }
 
 /* return the length of the event queue, or -1 if the queue is invalid */
@@ -88,25 +118,11 @@ int eq_len(const struct event_queue *queue) {
 	if (queue == NULL) {
 		return -1;
 	}
-	int size = 0;
-	struct event_queue_node *ptr;
-	ptr = queue->head;
-	while(ptr != NULL) {
-		ptr = ptr->next;
-		++size;
-	}
-	return size;
+	return queue->len;
 }
 
-/* return the length of the event queue, or -1 if the queue is invalid */
+/* remove all items from the event queue */
 void eq_clear(struct event_queue *queue) {
 	if (queue == NULL) { return; }
-	struct event_queue_node *node = queue->head;
-	while ((node = queue->head) != NULL) {
-		node = node->next;
-		free(queue->head);
-		queue->head = node;
-	}
-	queue->head = NULL;
+	queue->len = 0;
 }
-
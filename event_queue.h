@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
+#include <inttypes.h>
+
 /* all of the types of event which can be handled by the game engine */
 enum game_event_type {
 	/* no event (pseudo-event) */
@@ -20,8 +23,22 @@ enum game_event_type {
 	GE_GAMEOVER,
 	/* entrance */
 	GE_ENTER, /* called during phase transitions */
+	/* held shift keys, for input that can tell presses from releases */
+	GE_LPRESS,
+	GE_RPRESS,
+	GE_LRELEASE,
+	GE_RRELEASE,
+	/* the repeat timer of a held shift key */
+	GE_AUTOSHIFT,
 };
 
+/* true for the events that player input may send, as opposed to those the
+ * engine schedules for itself */
+bool ge_is_input(enum game_event_type type);
+
+/* the lowercase name of an event type, or NULL if there is no such type */
+const char * ge_name(enum game_event_type type);
+
 struct game_event {
 	/* the type of event this is */
 	enum game_event_type type;
@@ -29,13 +46,26 @@ struct game_event {
 	int64_t time;
 };
 
-/* a priority queue of events, from earliest (lowest) time to latest. */
-struct event_queue;
+/* the most events a queue can hold at once. the engine keeps at most two
+ * of its own pending, the fall, lock or entrance timer of its phase and the
+ * GE_AUTOSHIFT of a held key, so the other 4 are room for input that has
+ * not been stepped. keeping it small keeps the queue inside a game */
+#define EQ_CAPACITY 6
 
-/* allocate and create an event queue */
-struct event_queue * create_eq();
-/* destroy and deallocate an event queue */
-void destroy_eq(struct event_queue *);
+/* a priority queue of events, from earliest (lowest) time to latest.
+ * the queue is a fixed-size sorted array so that it can live inside a game
+ * and never allocates. events with equal times keep the order they were
+ * pushed in */
+struct event_queue {
+	/* the times and types of the queued events, earliest first */
+	int64_t times[EQ_CAPACITY];
+	uint8_t types[EQ_CAPACITY];
+	/* the number of queued events */
+	uint8_t len;
+};
+
+/* initialize an empty event queue */
+void eq_init(struct event_queue *);
 
 /**
  * eq_peek
@@ -53,7 +83,24 @@ bool eq_peek(const struct event_queue *queue, struct game_event *evt);
  */
 bool eq_pop(struct event_queue *queue, struct game_event *event);
 
-void eq_push(struct event_queue *queue, struct game_event event);
+/**
+ * eq_push
+ * adds an event to the queue, after any others with the same time
+ * returns false, dropping the event, if the queue is full
+ */
+bool eq_push(struct event_queue *queue, struct game_event event);
+
+/**
+ * eq_remove
+ * removes every event of the given type from the queue
+ */
+void eq_remove(struct event_queue *queue, enum game_event_type type);
+
+/**
+ * eq_keep
+ * removes every event but those of the given type from the queue
+ */
+void eq_keep(struct event_queue *queue, enum game_event_type type);
 
 /**
  * eq_len
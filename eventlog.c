@@ -0,0 +1,212 @@
+#include <stdlib.h> /* aligned_alloc() and free() */
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <assert.h> /* static_assert */
+#include <errno.h>
+#include <time.h> /* clock_gettime() and nanosleep() */
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* close() */
+#include <pthread.h>
+#include <sys/stat.h> /* fstat() */
+#include <sys/uio.h> /* writev() */
+
+#include "eventlog.h"
+
+static_assert(sizeof(struct log_record) == 16, "log records must stay 16 bytes");
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+
+/* the ring is a bounded multi-producer queue: slot i may be written by the
+ * producer that claims position p when seqs[i] == p, and read by the writer
+ * when seqs[i] == p + 1. the writer hands the slot back for position
+ * p + LOG_RING_SLOTS once the record is on its way to disk. the records are
+ * kept apart from the sequence numbers so that runs of them can go straight
+ * to writev() */
+struct event_log {
+	int fd;
+	pthread_t writer;
+	atomic_bool stopping;
+	/* the next position producers will claim */
+	_Alignas(64) _Atomic uint64_t head;
+	/* the records dropped, and how many of those the writer has logged */
+	_Alignas(64) _Atomic uint64_t dropped;
+	uint64_t dropped_logged;
+	/* the next position the writer will take, only touched by the writer */
+	_Alignas(64) uint64_t tail;
+	_Atomic uint64_t seqs[LOG_RING_SLOTS];
+	struct log_record records[LOG_RING_SLOTS];
+};
+
+bool event_log_append(struct event_log *log, const struct log_record *record) {
+	uint64_t pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+	for (;;) {
+		size_t slot = pos & (LOG_RING_SLOTS - 1);
+		uint64_t seq = atomic_load_explicit(&log->seqs[slot], memory_order_acquire);
+		int64_t lag = (int64_t) (seq - pos);
+		if (lag == 0) {
+			/* the slot is free, claim it. on failure pos is reloaded */
+			if (atomic_compare_exchange_weak_explicit(&log->head, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed)) {
+				log->records[slot] = *record;
+				atomic_store_explicit(&log->seqs[slot], pos + 1, memory_order_release);
+				return true;
+			}
+		} else if (lag < 0) {
+			/* the writer has not handed this slot back yet: the ring is full */
+			atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+			return false;
+		} else {
+			/* another producer got here first */
+			pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+		}
+	}
+}
+
+uint64_t event_log_dropped(const struct event_log *log) {
+	return atomic_load_explicit(&log->dropped, memory_order_relaxed);
+}
+
+/* write every iovec out in full, retrying partial writes */
+static void write_all(int fd, struct iovec *iov, int count) {
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return; /* nowhere to report it, the records are lost */
+		}
+		while (count > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			++iov;
+			--count;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+}
+
+/* write out whatever is ready in one writev(), returns the number of records */
+static size_t log_flush(struct event_log *log) {
+	size_t ready = 0;
+	while (ready < LOG_RING_SLOTS) {
+		uint64_t pos = log->tail + ready;
+		if (atomic_load_explicit(&log->seqs[pos & (LOG_RING_SLOTS - 1)], memory_order_acquire) != pos + 1) {
+			break;
+		}
+		++ready;
+	}
+
+	struct iovec iov[3];
+	int count = 0;
+	/* report drops ahead of the records that made it */
+	struct log_record drops;
+	uint64_t dropped = atomic_load_explicit(&log->dropped, memory_order_relaxed);
+	if (dropped != log->dropped_logged) {
+		struct timespec spec;
+		clock_gettime(CLOCK_MONOTONIC, &spec);
+		uint64_t lost = dropped - log->dropped_logged;
+		drops = (struct log_record) {
+			.time = spec.tv_sec * 1000000000L + spec.tv_nsec,
+			.game = lost > UINT32_MAX ? UINT32_MAX : (uint32_t) lost,
+			.kind = LR_DROPPED,
+		};
+		log->dropped_logged = dropped;
+		iov[count].iov_base = &drops;
+		iov[count++].iov_len = sizeof(drops);
+	}
+	/* the ready records, in two pieces if they wrap around the ring */
+	size_t first = log->tail & (LOG_RING_SLOTS - 1);
+	size_t run = ready < LOG_RING_SLOTS - first ? ready : LOG_RING_SLOTS - first;
+	if (run > 0) {
+		iov[count].iov_base = &log->records[first];
+		iov[count++].iov_len = run * sizeof(struct log_record);
+	}
+	if (ready > run) {
+		iov[count].iov_base = &log->records[0];
+		iov[count++].iov_len = (ready - run) * sizeof(struct log_record);
+	}
+	write_all(log->fd, iov, count);
+
+	/* hand the slots back to the producers */
+	for (size_t i = 0; i < ready; ++i) {
+		uint64_t pos = log->tail + i;
+		atomic_store_explicit(&log->seqs[pos & (LOG_RING_SLOTS - 1)], pos + LOG_RING_SLOTS, memory_order_release);
+	}
+	log->tail += ready;
+	return ready;
+}
+
+static void * log_writer(void *arg) {
+	struct event_log *log = (struct event_log *) arg;
+	const struct timespec pause = { .tv_sec = 0, .tv_nsec = LOG_FLUSH_INTERVAL };
+	for (;;) {
+		/* read the flag first, so that nothing appended before it was set is missed */
+		bool stopping = atomic_load(&log->stopping);
+		if (log_flush(log) == 0) {
+			if (stopping) {
+				return NULL;
+			}
+			nanosleep(&pause, NULL);
+		}
+	}
+}
+
+struct event_log * create_event_log(const char *path) {
+	/* malloc() only aligns to max_align_t, and the producers' and the
+	 * writer's fields must each start a cache line of their own */
+	size_t size = (sizeof(struct event_log) + 63) & ~(size_t) 63;
+	struct event_log *log = (struct event_log *) aligned_alloc(64, size);
+	if (log == NULL) {
+		return NULL;
+	}
+	if ((log->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+		free(log);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(log->fd, &st) == 0 && st.st_size == 0) {
+		struct log_header header = {
+			.magic = LOG_MAGIC,
+			.version = LOG_VERSION,
+			.record_size = sizeof(struct log_record),
+		};
+		struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+		write_all(log->fd, &iov, 1);
+	}
+	atomic_init(&log->stopping, false);
+	atomic_init(&log->head, 0);
+	atomic_init(&log->dropped, 0);
+	log->dropped_logged = 0;
+	log->tail = 0;
+	for (size_t i = 0; i < LOG_RING_SLOTS; ++i) {
+		atomic_init(&log->seqs[i], i);
+	}
+
+	struct timespec real, mono;
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	struct log_record start = {
+		.time = (real.tv_sec - mono.tv_sec) * 1000000000L + (real.tv_nsec - mono.tv_nsec),
+		.kind = LR_START,
+	};
+	event_log_append(log, &start);
+
+	if (pthread_create(&log->writer, NULL, log_writer, log) != 0) {
+		close(log->fd);
+		free(log);
+		return NULL;
+	}
+	return log;
+}
+
+void destroy_event_log(struct event_log *log) {
+	if (log == NULL) {
+		return;
+	}
+	atomic_store(&log->stopping, true);
+	pthread_join(log->writer, NULL);
+	close(log->fd);
+	free(log);
+}
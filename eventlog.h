@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* binary event log interface header
+ *
+ * engines append fixed-size records to a preallocated lock-free ring, and a
+ * background thread batches whatever is in the ring onto the end of the log
+ * file with writev(). appending never blocks and never allocates: if the
+ * writer has fallen behind and the ring is full the record is dropped and
+ * counted, and the writer logs the count once it catches up.
+ *
+ * the file is a struct log_header followed by struct log_records, in the
+ * byte order of the machine that wrote them. a file may hold several runs
+ * one after the other, each starting with an LR_START record.
+ */
+
+/* identifies an event log file ("tetrlog1") */
+#define LOG_MAGIC 0x31676f6c72746574ULL
+/* bumped whenever the layout below changes */
+#define LOG_VERSION 1
+/* the number of records the ring holds, must be a power of two */
+#define LOG_RING_SLOTS 65536
+/* how long the writer sleeps when the ring is empty, in nanoseconds */
+#define LOG_FLUSH_INTERVAL 2000000L
+
+/* what a record describes */
+enum log_kind {
+	/* a run of the program began. time is the offset to add to the
+	 * CLOCK_MONOTONIC times that follow to get CLOCK_REALTIME */
+	LR_START = 0,
+	/* game_step() processed an event. type is the enum game_event_type */
+	LR_EVENT,
+	/* the engine changed phase. type is the new enum engine_phase */
+	LR_PHASE,
+	/* records were dropped because the ring was full. game is how many */
+	LR_DROPPED,
+};
+
+struct log_header {
+	uint64_t magic;
+	uint32_t version;
+	/* sizeof(struct log_record) */
+	uint32_t record_size;
+};
+
+struct log_record {
+	/* the engine time, in CLOCK_MONOTONIC nanoseconds */
+	int64_t time;
+	/* which game this came from, see game_set_log() */
+	uint32_t game;
+	/* the enum log_kind */
+	uint8_t kind;
+	/* the event or phase, depending on kind */
+	uint8_t type;
+	/* the enum engine_phase the engine was in beforehand */
+	uint8_t phase;
+	uint8_t _reserved;
+};
+
+/* a log file and the thread writing it */
+struct event_log;
+
+/* open path for appending and start the writer, returns NULL on failure */
+struct event_log * create_event_log(const char *path);
+/* write out everything appended so far, stop the writer and close the file */
+void destroy_event_log(struct event_log *);
+
+/**
+ * event_log_append
+ * queue a record for the writer. safe to call from any number of threads
+ * returns false, counting the record as dropped, if the ring is full
+ */
+bool event_log_append(struct event_log *, const struct log_record *record);
+
+/* the number of records dropped so far */
+uint64_t event_log_dropped(const struct event_log *);
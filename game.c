@@ -0,0 +1,595 @@
+#include <stdlib.h> /* malloc() and free() */
+#include <stdbool.h>
+#include <assert.h> /* static_assert */
+#include <time.h> /* clock_gettime() */
+#include <string.h> /* memcmp() */
+
+#include "tetrimino.h"
+#include "bag.h"
+#include "grid.h"
+#include "event_queue.h"
+#include "state.h"
+#include "placement.h"
+#include "eventlog.h"
+
+// TODO: standardize on one calling convention (out params, or return values or something)
+
+/* everything about a game lives in this one allocation-free struct, so
+ * that batches of games stay dense in memory */
+struct game_state {
+	/* the randomizer */
+	struct tetris_bag bag;
+	/* the 10x40 play field grid */
+	struct tetris_grid grid;
+	/* the "current" piece */
+	struct tetrimino piece;
+	/* true if the current piece is valid */
+	bool piece_active;
+	/* current phase the tetris engine is in, as an enum engine_phase */
+	uint8_t phase;
+	/* true when the game is paused, false otherwise */
+	bool paused;
+	/* true when it's time for game to exit */
+	bool exiting;
+	/* the shift key being held: -1 for left, 1 for right, 0 for neither */
+	int8_t shift_held;
+	/* true once the held key has waited out the delay and is repeating */
+	bool shift_charged;
+	/* the delayed auto shift and auto repeat rate, in nanoseconds */
+	int32_t das, arr;
+	/* the falling speed of blocks */
+	int32_t level;
+	/* state for marking which lines are to be deleted in the pattern phase */
+	unsigned long long int lines_marked : GRID_HEIGHT;
+	/* the number of lines successfully cleared */
+	int32_t lines_cleared;
+	/* the id this game goes by in its event log */
+	uint32_t log_game;
+	/* event queue - TODO: should this be part of the state? */
+	struct event_queue events;
+	/* the nanotime since at which the game started */
+	int64_t start_time;
+	/* the nanotime since the most recent event processed */
+	int64_t now;
+	/* where to log events and phase changes, NULL if nowhere */
+	struct event_log *log;
+	/* told about every lock, if not NULL */
+	game_lock_observer on_lock;
+	void *on_lock_ctx;
+};
+
+/* how many games fit in cache is what limits batch evaluation: 256 bytes
+ * with the standard 40 row grid, plus whatever a taller grid adds */
+static_assert(sizeof(struct game_state) <= 256 + sizeof(struct tetris_grid) - 40 * sizeof(uint16_t),
+		"struct game_state has outgrown 256 bytes");
+
+void phase_transition(struct game_state *state, enum engine_phase phase);
+
+void generate_piece(struct game_state *state);
+
+bool game_paused(const struct game_state *state) {
+	return state->paused;
+}
+
+const struct tetris_grid * game_grid(const struct game_state *state) {
+	return &state->grid;
+}
+
+
+void step_generation(struct game_state *state, const struct game_event *event);
+void step_falling(struct game_state *state, const struct game_event *event);
+void step_lock(struct game_state *state, const struct game_event *event);
+void step_pattern(struct game_state *state, const struct game_event *event);
+void step_iterate(struct game_state *state, const struct game_event *event);
+void step_animate(struct game_state *state, const struct game_event *event);
+void step_eliminate(struct game_state *state, const struct game_event *event);
+void step_completion(struct game_state *state, const struct game_event *event);
+
+void (*phase_handlers[NUM_ENGINE_PHASES])(struct game_state *state, const struct game_event *event) = {
+	step_generation,
+	step_falling,
+	step_lock,
+	step_pattern,
+	step_iterate,
+	step_animate,
+	step_eliminate,
+	step_completion,
+
+	0,0,0
+};
+
+/* move the piece one column if it can go there, returns false if not */
+static bool shift_piece(struct game_state *state, int dir) {
+	state->piece.pos_x += dir;
+	if (!valid_placement(&state->grid, state->piece)) {
+		state->piece.pos_x -= dir;
+		return false;
+	}
+	return true;
+}
+
+/* schedule the next repeat of the held shift key */
+static void schedule_autoshift(struct game_state *state, int64_t time) {
+	struct game_event repeat = { .type = GE_AUTOSHIFT, .time = time };
+	eq_push(&state->events, repeat);
+}
+
+/* track held shift keys. their repeat timer survives phase transitions, so
+ * a key held through a lock carries its charge over to the next piece */
+static void step_autoshift(struct game_state *state, const struct game_event *event) {
+	switch (event->type) {
+		case GE_LPRESS: /* intentional fall-through */
+		case GE_RPRESS:
+			state->shift_held = event->type == GE_LPRESS ? -1 : 1;
+			state->shift_charged = false;
+			eq_remove(&state->events, GE_AUTOSHIFT);
+			schedule_autoshift(state, event->time + state->das);
+			break;
+		case GE_LRELEASE: /* intentional fall-through */
+		case GE_RRELEASE:
+			/* letting go of a key that was overridden by the other changes nothing */
+			if (state->shift_held == (event->type == GE_LRELEASE ? -1 : 1)) {
+				state->shift_held = 0;
+				state->shift_charged = false;
+				eq_remove(&state->events, GE_AUTOSHIFT);
+			}
+			break;
+		case GE_AUTOSHIFT:
+			if (state->shift_held != 0) {
+				state->shift_charged = true;
+				/* at ARR 0 the piece is kept against the wall after every step instead */
+				if (state->arr > 0) {
+					schedule_autoshift(state, event->time + state->arr);
+				}
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* append a record to the game's log, if it has one */
+static inline void log_engine(struct game_state *state, enum log_kind kind, int64_t time, uint8_t type) {
+	if (state->log != NULL) {
+		struct log_record record = {
+			.time = time,
+			.game = state->log_game,
+			.kind = kind,
+			.type = type,
+			.phase = (uint8_t) state->phase,
+		};
+		event_log_append(state->log, &record);
+	}
+}
+
+void game_step(struct game_state *state, const struct game_event *event) {
+	log_engine(state, LR_EVENT, event->time, (uint8_t) event->type);
+	if (phase_handlers[state->phase] != NULL) {
+		phase_handlers[state->phase](state, event);
+	}
+
+	step_autoshift(state, event);
+
+	if (event->type == GE_QUIT) {
+		state->exiting = true;
+	}
+
+	/* TODO: don't special case this, move logic into phase handler for newgame */
+	if (event->type == GE_NEWGAME) {
+		eq_clear(&state->events); 
+		state->shift_held = 0;
+		state->shift_charged = false;
+		phase_transition(state, EP_GENERATION);
+	}
+
+	/* respond to player input */
+	if (state->piece_active) {
+		switch (event->type) {
+			case GE_LSHIFT: /* intentional fall-through */
+			case GE_LPRESS:
+				shift_piece(state, -1);
+				break;
+			case GE_RSHIFT: /* intentional fall-through */
+			case GE_RPRESS:
+				shift_piece(state, 1);
+				break;
+			case GE_AUTOSHIFT:
+				if (state->shift_held != 0 && state->arr > 0) {
+					shift_piece(state, state->shift_held);
+				}
+				break;
+			case GE_CWROTATE:
+				{
+					/* TODO: generate kick translations and sequentially test */
+					struct tetrimino potential = tet_rotate_cw(state->piece);
+					if (valid_placement(&state->grid, potential)) {
+						state->piece = potential;
+					}
+				}
+				break;
+			case GE_CCWROTATE:
+				{
+					/* TODO: generate kick translations and sequentially test */
+					struct tetrimino potential = tet_rotate_ccw(state->piece);
+					if (valid_placement(&state->grid, potential)) {
+						state->piece = potential;
+					}
+				}
+				break;
+			case GE_HARDDROP:
+				while (valid_placement(&state->grid, state->piece)) {
+					state->piece.pos_y--;
+				}
+				state->piece.pos_y++;
+				/* TODO: replace with a transition to the lockdown state */
+				phase_transition(state, EP_PATTERN);
+				break;
+			case GE_SOFTDROP:
+				state->piece.pos_y--;
+				if (!valid_placement(&state->grid, state->piece)) {
+					state->piece.pos_y++;
+					/* TODO: transition to lockdown state instead */
+					phase_transition(state, EP_PATTERN);
+				}
+				break;
+			case GE_PAUSE:
+				if (state->paused == true) {
+					state->paused = false;
+				} else {
+					state->paused = true;
+				}
+				break;
+			default:
+				break;
+		}
+		/* ARR 0: a charged key holds the piece against the wall, whatever
+		 * else happened to it. at most GRID_WIDTH shifts */
+		if (state->shift_charged && state->arr == 0 && state->piece_active) {
+			while (shift_piece(state, state->shift_held)) {
+			}
+		}
+	}
+
+	/* update the event */
+	if (event->time > state->now) {
+		state->now = event->time;
+	}
+}
+
+int64_t now64() {
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return spec.tv_sec * 1000000000L + spec.tv_nsec;
+}
+
+/* initializes a game state structure. returns 0 on success */
+int game_init(struct game_state *state, unsigned int seed) {
+	if (state == NULL) {
+		return -1;
+	}
+	tg_clear(&state->grid); /* clear grid */
+	bag_init(&state->bag, seed); /*initialize bag */
+	eq_init(&state->events); /* initialize event queue */
+
+	state->now = state->start_time = now64();
+
+	state->phase = EP_NEWGAME;
+	state->piece_active = false;
+	state->paused = false;
+	state->exiting = false; /* TODO: do I need this? */
+	state->shift_held = 0;
+	state->shift_charged = false;
+	state->das = GAME_DEFAULT_DAS;
+	state->arr = GAME_DEFAULT_ARR;
+	state->log = NULL;
+	state->log_game = 0;
+	state->on_lock = NULL;
+	state->on_lock_ctx = NULL;
+	state->level = 0;
+	state->lines_cleared = 0;
+
+	return 0;
+}
+
+struct game_state * create_game(unsigned int seed) {
+	struct game_state *state = (struct game_state *) malloc(sizeof(struct game_state));
+	if (state == NULL) {
+		return NULL;
+	}
+	if (game_init(state, seed) != 0) {
+		free(state);
+		return NULL;
+	}
+	return state;
+}
+
+void destroy_game(struct game_state *state) {
+	if (state == NULL) {
+		return;
+	}
+	free(state);
+}
+
+struct game_pool {
+	size_t count;
+	struct game_state *games;
+};
+
+struct game_pool * create_game_pool(size_t count, unsigned int first_seed) {
+	struct game_pool *pool = (struct game_pool *) malloc(sizeof(struct game_pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	/* one block, cache line aligned, with the games back to back */
+	size_t size = (count * sizeof(struct game_state) + 63) & ~(size_t) 63;
+	pool->games = (struct game_state *) aligned_alloc(64, size > 0 ? size : 64);
+	if (pool->games == NULL) {
+		free(pool);
+		return NULL;
+	}
+	pool->count = count;
+	for (size_t i = 0; i < count; ++i) {
+		game_init(&pool->games[i], first_seed + (unsigned int) i);
+	}
+	return pool;
+}
+
+void destroy_game_pool(struct game_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+	free(pool->games);
+	free(pool);
+}
+
+struct game_state * game_pool_get(struct game_pool *pool, size_t i) {
+	return &pool->games[i];
+}
+
+size_t game_pool_size(const struct game_pool *pool) {
+	return pool->count;
+}
+
+bool game_push_event(struct game_state *state, struct game_event event) {
+	return eq_push(&state->events, event);
+}
+
+/* STEP HANDLERS */
+/* This is where the meat of the state transition flow goes */
+
+void step_generation(struct game_state *state, const struct game_event *event) {
+	if (event->type == GE_ENTER) {
+		state->piece = TETRIMINOS[bag_pull(&state->bag)];
+		/* if there is a piece in the way of generation, the game is over */
+		if (!valid_placement(&state->grid, state->piece)) {
+			phase_transition(state, EP_GAMEOVER);
+		} else {
+			phase_transition(state, EP_FALLING);
+		}
+	} else {
+		// TODO: handle other types of events here
+		// user input events should probably be buffered
+	}
+}
+
+void step_falling(struct game_state *state, const struct game_event *event) {
+	/* attempt to fall once */
+	/* if successful */
+	if (event->type == GE_ENTER) {
+		state->piece_active = true;
+		state->piece.pos_y--;
+		if (!valid_placement(&state->grid, state->piece)) {
+			state->piece.pos_y++;
+			phase_transition(state, EP_LOCK);
+			return;
+		}
+		struct game_event next_fall = {
+			.type = GE_ENTER,
+			.time = event->time + 1000000000L // TODO: use the level speed
+		};
+		eq_push(&state->events, next_fall);
+	}
+}
+
+void step_lock(struct game_state *state, const struct game_event *event) {
+	if (event->type == GE_ENTER) {
+		struct game_event lockdown = {
+			.type = GE_LOCKDOWN,
+			.time = event->time + 500000000L // TODO: use the lock delay
+		};
+		eq_push(&state->events, lockdown);
+	} else if (event->type == GE_LOCKDOWN) {
+		phase_transition(state, EP_PATTERN);
+	}
+}
+
+void step_pattern(struct game_state *state, const struct game_event *event) {
+	state->piece_active = false;
+	lockdown(&state->grid, state->piece);
+	state->lines_marked = 0;
+	for (int row = 0; row < GRID_HEIGHT; ++row) {
+		bool good = state->grid.rows[row] == GRID_FULL_ROW;
+		state->lines_marked |= ((unsigned long long int)good) << row;
+	}
+	if (state->on_lock != NULL) {
+		state->on_lock(state->on_lock_ctx, state, &state->piece, __builtin_popcountll(state->lines_marked));
+	}
+	phase_transition(state, EP_ITERATE);
+}
+void step_iterate(struct game_state *state, const struct game_event *event) {
+	phase_transition(state, EP_ANIMATE);
+}
+void step_animate(struct game_state *state, const struct game_event *event) {
+	phase_transition(state, EP_ELIMINATE);
+}
+void step_eliminate(struct game_state *state, const struct game_event *event) {
+	/* top down, so that removing a line does not move the ones still marked */
+	for (int row = GRID_HEIGHT - 1; row >= 0; --row) {
+		if (state->lines_marked & (1ULL << row)) {
+			tg_rmline(&state->grid, row);
+			++state->lines_cleared;
+		}
+	}
+	phase_transition(state, EP_COMPLETION);
+}
+void step_completion(struct game_state *state, const struct game_event *event) {
+	phase_transition(state, EP_GENERATION);
+}
+
+void phase_transition(struct game_state *state, enum engine_phase phase) {
+	struct game_event entrance = {
+		.type = GE_ENTER,
+		.time = state->now
+	};
+	log_engine(state, LR_PHASE, state->now, (uint8_t) phase);
+	state->phase = phase;
+	eq_keep(&state->events, GE_AUTOSHIFT);
+	eq_push(&state->events, entrance);
+}
+
+void generate_piece(struct game_state *state) {
+	state->piece = TETRIMINOS[bag_pull(&state->bag)];
+}
+
+int game_advance(struct game_state *state, int64_t now) {
+	int steps = 0;
+	struct game_event event;
+	while (eq_peek(&state->events, &event) && now >= event.time) {
+		eq_pop(&state->events, &event);
+		game_step(state, &event);
+		++steps;
+	}
+	return steps;
+}
+
+int game_step_many(struct game_state *state, const struct game_event *events, size_t n) {
+	int steps = 0;
+	for (size_t i = 0; i < n; ++i) {
+		/* everything scheduled before an input happens first, as if it
+		 * had been queued */
+		steps += game_advance(state, events[i].time);
+		game_step(state, &events[i]);
+		++steps;
+	}
+	if (n > 0) {
+		steps += game_advance(state, events[n - 1].time);
+	}
+	return steps;
+}
+
+/* true if a step took the game from before to after. only the fields a
+ * step can change are compared, the ones fixed at set up are left out */
+static bool step_changed(const struct game_state *before, const struct game_state *after) {
+	const struct tetrimino *a = &before->piece, *b = &after->piece;
+	if (a->type != b->type || a->rs != b->rs || a->pos_x != b->pos_x || a->pos_y != b->pos_y ||
+			memcmp(a->minos, b->minos, sizeof(a->minos)) != 0) {
+		return true;
+	}
+	if (before->piece_active != after->piece_active || before->phase != after->phase ||
+			before->paused != after->paused || before->exiting != after->exiting) {
+		return true;
+	}
+	if (before->shift_held != after->shift_held || before->shift_charged != after->shift_charged) {
+		return true;
+	}
+	const struct event_queue *qa = &before->events, *qb = &after->events;
+	if (qa->len != qb->len || memcmp(qa->times, qb->times, qa->len * sizeof(qa->times[0])) != 0 ||
+			memcmp(qa->types, qb->types, qa->len * sizeof(qa->types[0])) != 0) {
+		return true;
+	}
+	return before->lines_marked != after->lines_marked || before->lines_cleared != after->lines_cleared ||
+		before->bag.random_state != after->bag.random_state || before->bag.next != after->bag.next ||
+		memcmp(&before->grid, &after->grid, sizeof(struct tetris_grid)) != 0;
+}
+
+size_t game_coalesce(const struct game_state *state, struct game_event *events, size_t n) {
+	/* play the events on a copy and keep the ones that changed something */
+	struct game_state sim = *state;
+	sim.log = NULL;
+	sim.on_lock = NULL;
+	size_t kept = 0;
+	for (size_t i = 0; i < n; ++i) {
+		game_advance(&sim, events[i].time);
+		struct game_state before = sim;
+		game_step(&sim, &events[i]);
+		if (step_changed(&before, &sim)) {
+			events[kept++] = events[i];
+		}
+	}
+	return kept;
+}
+
+int64_t game_next_event_time(const struct game_state *state) {
+	struct game_event peek;
+	if (eq_peek(&state->events, &peek)) {
+		return peek.time;
+	}
+	return -1;
+}
+
+void game_mirror(struct game_state *state, const struct tetris_grid *grid, const struct tetrimino *piece,
+		enum engine_phase phase, bool paused, int64_t level, int64_t lines_cleared) {
+	state->grid = *grid;
+	state->piece_active = piece != NULL;
+	if (piece != NULL) {
+		state->piece = *piece;
+	}
+	state->phase = phase;
+	state->paused = paused;
+	state->level = (int32_t) level;
+	state->lines_cleared = (int32_t) lines_cleared;
+}
+
+int64_t game_level(const struct game_state *state) {
+	return state->level;
+}
+int64_t game_lines_cleared(const struct game_state *state) {
+	return state->lines_cleared;
+}
+const struct event_queue * game_queue(const struct game_state *state) {
+	return &state->events;
+}
+enum engine_phase game_phase(const struct game_state *state) {
+	return state->phase;
+}
+bool game_exiting(const struct game_state *state) {
+	return state->exiting;
+}
+void game_set_lock_observer(struct game_state *state, game_lock_observer observer, void *ctx) {
+	state->on_lock = observer;
+	state->on_lock_ctx = ctx;
+}
+
+void game_set_log(struct game_state *state, struct event_log *log, uint32_t id) {
+	state->log = log;
+	state->log_game = id;
+}
+
+/* clamp a DAS or ARR setting into the range the state can hold */
+static int32_t autoshift_clamp(int64_t time) {
+	return (int32_t) (time < 0 ? 0 : time > GAME_MAX_AUTOSHIFT ? GAME_MAX_AUTOSHIFT : time);
+}
+
+void game_set_autoshift(struct game_state *state, int64_t das, int64_t arr) {
+	state->das = autoshift_clamp(das);
+	state->arr = autoshift_clamp(arr);
+}
+int64_t game_das(const struct game_state *state) {
+	return state->das;
+}
+int64_t game_arr(const struct game_state *state) {
+	return state->arr;
+}
+int64_t game_now(const struct game_state *state) {
+	return state->now;
+}
+enum tetrimino_type game_next(const struct game_state *state, unsigned int n) {
+	return bag_peek(&state->bag, n);
+}
+
+const struct tetrimino * game_piece(const struct game_state *state) {
+	if (!state->piece_active) {
+		return NULL;
+	}
+	return &state->piece;
+}
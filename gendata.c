@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h> /* getopt() and sysconf() */
+#include <pthread.h>
+
+#include "bot.h"
+#include "bag.h"
+#include "placement.h"
+#include "dataset.h"
+#include "state.h" /* now64() */
+
+/* gendata plays games with the autoplayer on a pool of threads and writes
+ * every placement to a training dataset, see dataset.h. each thread plays
+ * whole games, seeds being handed out in turn, and holds a game's records
+ * back until it ends so that they can carry how it ended.
+ *
+ * usage: gendata [-j threads] [-n games] [-p max_pieces] [-s first_seed]
+ *                [-z level] dataset_file
+ */
+
+struct gendata_job {
+	struct dataset *dataset;
+	unsigned int first_seed;
+	int games;
+	int max_pieces;
+	/* the games handed out so far */
+	atomic_int next_game;
+	_Atomic uint64_t records, lines;
+};
+
+/* play the game dealt from seed, filling records with its placements.
+ * returns how many there were, and sets *topped_out */
+static int play_game(unsigned int seed, int max_pieces, struct dataset_record *records, bool *topped_out) {
+	struct tetris_grid grid;
+	struct tetris_bag bag;
+	struct move move;
+	tg_clear(&grid);
+	bag_init(&bag, seed);
+	int count = 0;
+	*topped_out = false;
+	while (count < max_pieces) {
+		enum tetrimino_type type = bag_pull(&bag);
+		if (!bot_choose(&grid, type, &BOT_DEFAULT_WEIGHTS, &move)) {
+			*topped_out = true;
+			break;
+		}
+		struct dataset_record *record = &records[count++];
+		memcpy(record->board, grid.rows, sizeof(record->board));
+		record->piece = (uint8_t) type;
+		for (int i = 0; i < DATASET_NEXT; ++i) {
+			record->next[i] = (uint8_t) bag_peek(&bag, i);
+		}
+		record->placement = (struct placement) {
+			.type = (uint8_t) move.piece.type, .rs = (uint8_t) move.piece.rs,
+			.x = move.piece.pos_x, .y = move.piece.pos_y,
+		};
+		lockdown(&grid, move.piece);
+		record->lines = (uint8_t) tg_clear_lines(&grid);
+		record->seed = seed;
+	}
+	return count;
+}
+
+static void * gendata_worker(void *arg) {
+	struct gendata_job *job = (struct gendata_job *) arg;
+	struct dataset_writer *writer = create_dataset_writer(job->dataset);
+	struct dataset_record *records = (struct dataset_record *) malloc(job->max_pieces * sizeof(struct dataset_record));
+	if (writer == NULL || records == NULL) {
+		error(1, 0, "out of memory");
+	}
+	int game;
+	while ((game = atomic_fetch_add(&job->next_game, 1)) < job->games) {
+		bool topped_out;
+		int count = play_game(job->first_seed + game, job->max_pieces, records, &topped_out);
+		uint32_t lines = 0;
+		for (int i = 0; i < count; ++i) {
+			lines += records[i].lines;
+		}
+		for (int i = 0; i < count; ++i) {
+			records[i].game_lines = lines;
+			records[i].topped_out = topped_out;
+			dataset_write(writer, &records[i]);
+		}
+		atomic_fetch_add(&job->records, count);
+		atomic_fetch_add(&job->lines, lines);
+	}
+	free(records);
+	destroy_dataset_writer(writer);
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	static const char usage[] = "usage: %s [-j threads] [-n games] [-p max_pieces] [-s first_seed] [-z level] dataset_file";
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int games = 100;
+	int max_pieces = 1000;
+	unsigned int first_seed = 1;
+	int level = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:n:p:s:z:")) != -1) {
+		switch (opt) {
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'n':
+				games = atoi(optarg);
+				break;
+			case 'p':
+				max_pieces = atoi(optarg);
+				break;
+			case 's':
+				first_seed = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'z':
+				level = atoi(optarg);
+				break;
+			default:
+				error(1, 0, usage, argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		error(1, 0, usage, argv[0]);
+	}
+	if (threads < 1 || games < 1 || max_pieces < 1 || level < 0 || level > 9) {
+		error(1, 0, "threads, games and max_pieces must be positive, and level from 0 to 9");
+	}
+
+	struct gendata_job job = {
+		.first_seed = first_seed,
+		.games = games,
+		.max_pieces = max_pieces,
+	};
+	atomic_init(&job.next_game, 0);
+	atomic_init(&job.records, 0);
+	atomic_init(&job.lines, 0);
+	if ((job.dataset = create_dataset(argv[optind], level)) == NULL) {
+		error(1, errno, "could not create %s", argv[optind]);
+	}
+
+	int64_t start = now64();
+	pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+	if (workers == NULL) {
+		error(1, 0, "out of memory");
+	}
+	for (int t = 0; t < threads; ++t) {
+		if (pthread_create(&workers[t], NULL, gendata_worker, &job) != 0) {
+			error(1, 0, "could not start worker thread");
+		}
+	}
+	for (int t = 0; t < threads; ++t) {
+		pthread_join(workers[t], NULL);
+	}
+	free(workers);
+	if (!destroy_dataset(job.dataset)) {
+		error(1, errno, "could not write %s", argv[optind]);
+	}
+	double seconds = (now64() - start) / 1e9;
+	uint64_t records = atomic_load(&job.records);
+	fprintf(stderr, "%d games, %" PRIu64 " records, %" PRIu64 " lines, %.3fs, %.0f records/s\n",
+			games, records, atomic_load(&job.lines), seconds, records / seconds);
+	return 0;
+}
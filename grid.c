@@ -1,19 +1,32 @@
 #include <string.h> /* memmove and memset */
 #include "grid.h"
 
-void tg_setcell(struct tetris_grid *grid, unsigned int col, unsigned int row, enum grid_cell cell) {
-	grid->cells[row * 10 + col] = cell;
+void tg_rmline(struct tetris_grid *grid, unsigned int line) {
+	memmove(grid->rows + line, grid->rows + line + 1, sizeof(uint16_t) * (GRID_HEIGHT - 1 - line));
+	grid->rows[GRID_HEIGHT - 1] = 0;
 }
 
-enum grid_cell tg_getcell(const struct tetris_grid *grid, unsigned int col, unsigned int row) {
-	return grid->cells[row * 10 + col];
+int tg_clear_lines(struct tetris_grid *grid) {
+	int kept = 0;
+	for (int row = 0; row < GRID_HEIGHT; ++row) {
+		if (grid->rows[row] != GRID_FULL_ROW) {
+			grid->rows[kept++] = grid->rows[row];
+		}
+	}
+	int cleared = GRID_HEIGHT - kept;
+	memset(grid->rows + kept, 0, sizeof(uint16_t) * cleared);
+	return cleared;
 }
 
-void tg_rmline(struct tetris_grid *grid, unsigned int line) {
-	memmove(grid->cells + (10*line), grid->cells + (10*(line+1)), sizeof(enum grid_cell) * 10 * (39-line));
-	memset(grid->cells + 390, (int) GC_EMPTY, sizeof(enum grid_cell) * 10);
+void tg_clear(struct tetris_grid *grid) {
+	memset(grid->rows, 0, sizeof(grid->rows));
 }
 
-void tg_clear(struct tetris_grid *grid) {
-	memset(grid->cells, (int) GC_EMPTY, sizeof(grid->cells));
+void tc_rmline(struct tetris_colors *colors, unsigned int line) {
+	memmove(colors->rows + line, colors->rows + line + 1, sizeof(uint64_t) * (GRID_HEIGHT - 1 - line));
+	colors->rows[GRID_HEIGHT - 1] = 0;
+}
+
+void tc_clear(struct tetris_colors *colors) {
+	memset(colors->rows, 0, sizeof(colors->rows));
 }
@@ -1,14 +1,40 @@
 #pragma once
 
+#include <assert.h> /* static_assert */
+#include <inttypes.h>
+
+/* the board's dimensions are compile-time constants, so that every loop
+ * over rows or columns has a fixed trip count and every row mask a fixed
+ * width. a board of another size is another build of the whole program,
+ * see the variants in the Makefile, and termtris -b picks between them */
+
 /* the width of a tetris grid */
+#ifndef GRID_WIDTH
 #define GRID_WIDTH 10
-/* the total height of a tetris grid */
+#endif
+/* the total height of a tetris grid, the Matrix and the Buffer Zone above it */
+#ifndef GRID_HEIGHT
 #define GRID_HEIGHT 40
-/* the visible height of a tetris grid */
-#define GRID_VISIBLE_HEIGHT 21
+#endif
+/* the visible height of a tetris grid, the Matrix and 1 row of the Buffer Zone */
+#ifndef GRID_VISIBLE_HEIGHT
+#define GRID_VISIBLE_HEIGHT (GRID_HEIGHT / 2 + 1)
+#endif
+/* a row with every cell occupied */
+#define GRID_FULL_ROW ((uint16_t) ((1 << GRID_WIDTH) - 1))
+/* where a new piece's origin is placed */
+#define GRID_SPAWN_X ((GRID_WIDTH - 1) / 2)
+#define GRID_SPAWN_Y (GRID_HEIGHT / 2)
+
+/* rows are 16 bit masks, and sets of rows 64 bit masks */
+static_assert(GRID_WIDTH >= 4 && GRID_WIDTH <= 16, "GRID_WIDTH must be between 4 and 16");
+static_assert(GRID_HEIGHT >= 8 && GRID_HEIGHT <= 64 && GRID_HEIGHT % 2 == 0, "GRID_HEIGHT must be even and between 8 and 64");
+/* the wire protocol marks changed rows with a bit each, and one more bit,
+ * in 64 bits */
+static_assert(GRID_VISIBLE_HEIGHT <= GRID_HEIGHT && GRID_VISIBLE_HEIGHT <= 63, "GRID_VISIBLE_HEIGHT cannot exceed GRID_HEIGHT or 63");
 
-/* the possible contents of a tetris grid cell
- * TODO: add support for colors / tetrimino-specific */
+/* the possible contents of a tetris grid cell. which piece filled a cell
+ * is kept apart, in struct tetris_colors */
 enum grid_cell {
 	GC_EMPTY = 0,
 	GC_FILL1 = 1,
@@ -17,20 +43,62 @@ enum grid_cell {
 
 struct tetris_grid {
 	/* the grid is indexed bottom up, left-to-right
-	 * the first 20 rows of 10 are the Buffer Zone
-	 * the next 20 rows are the Matrix, which is the main visible play area
+	 * the lower half of the rows are the Matrix, the main visible play area
+	 * the upper half are the Buffer Zone
+	 * each row is a bitmask of its occupied cells, bit n being column n
 	 */
-	enum grid_cell cells[GRID_WIDTH * GRID_HEIGHT];
+	uint16_t rows[GRID_HEIGHT];
 };
 
-/* set the value of a cell */
-void tg_setcell(struct tetris_grid *, unsigned int col, unsigned int row, enum grid_cell cell);
+/* set the value of a cell. any value but GC_EMPTY marks it occupied.
+ * inline, like tg_getcell(), so that it folds into the caller's loops */
+static inline void tg_setcell(struct tetris_grid *grid, unsigned int col, unsigned int row, enum grid_cell cell) {
+	if (cell == GC_EMPTY) {
+		grid->rows[row] &= ~(1 << col);
+	} else {
+		grid->rows[row] |= 1 << col;
+	}
+}
 
-/* get the value of a cell */
-enum grid_cell tg_getcell(const struct tetris_grid *, unsigned int col, unsigned int row);
+/* get the value of a cell, GC_FILL1 if occupied */
+static inline enum grid_cell tg_getcell(const struct tetris_grid *grid, unsigned int col, unsigned int row) {
+	return (grid->rows[row] >> col) & 1 ? GC_FILL1 : GC_EMPTY;
+}
 
 /* clear one line and shift the rest down 1*/
 void tg_rmline(struct tetris_grid *, unsigned int line);
 
+/* remove every full line, shifting the rest down. returns the number removed */
+int tg_clear_lines(struct tetris_grid *);
+
 /* clear the board */
 void tg_clear(struct tetris_grid *);
+
+/* the colour of a cell with nothing in it, or nothing known about it */
+#define TC_NONE 0
+
+/* which piece filled each cell of a grid, for drawing it in colour.
+ * the engine never touches this layer: it is owned by the display, which
+ * keeps it in step with the grid from the lock observer, see display_lock().
+ * it is indexed like struct tetris_grid */
+struct tetris_colors {
+	/* 4 bits per cell, column n in bits 4n to 4n+3, holding TC_NONE or
+	 * the enum tetrimino_type of the piece plus one */
+	uint64_t rows[GRID_HEIGHT];
+};
+
+/* set the colour of a cell, TC_NONE or a tetrimino_type plus one */
+static inline void tc_setcell(struct tetris_colors *colors, unsigned int col, unsigned int row, unsigned int color) {
+	colors->rows[row] = (colors->rows[row] & ~(0xfULL << (4 * col))) | ((uint64_t) (color & 0xf) << (4 * col));
+}
+
+/* get the colour of a cell */
+static inline unsigned int tc_getcell(const struct tetris_colors *colors, unsigned int col, unsigned int row) {
+	return (colors->rows[row] >> (4 * col)) & 0xf;
+}
+
+/* clear one line of colours and shift the rest down 1, like tg_rmline() */
+void tc_rmline(struct tetris_colors *, unsigned int line);
+
+/* clear every colour */
+void tc_clear(struct tetris_colors *);
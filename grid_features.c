@@ -0,0 +1,185 @@
+#include <string.h> /* memset() and memmove() */
+
+#include "grid_features.h"
+
+/* the walls either side of a row, as seen by row_transitions() */
+#define WALLED_ROW ((1U << (GRID_WIDTH + 2)) - 1)
+
+/* what there is to know about a column from its cells alone */
+static struct gf_column column_stats(uint64_t col) {
+	struct gf_column stats = { 0 };
+	if (col == 0) {
+		return stats;
+	}
+	int height = 64 - __builtin_clzll(col);
+	uint64_t below = ~0ULL >> (64 - height);
+	stats.height = height;
+	stats.holes = __builtin_popcountll(~col & below);
+	if (stats.holes > 0) {
+		stats.covered = __builtin_popcountll(col >> __builtin_ctzll(~col));
+	}
+	stats.transitions = __builtin_popcountll((col ^ ((col << 1) | 1)) & below);
+	return stats;
+}
+
+/* the transitions along a row, 0 for an empty one */
+static int row_transitions(uint16_t row) {
+	if (row == 0) {
+		return 0;
+	}
+	unsigned int walled = ((unsigned int) row << 1) | 1 | (1U << (GRID_WIDTH + 1));
+	return __builtin_popcount((walled ^ (walled >> 1)) & (WALLED_ROW >> 1));
+}
+
+/* remove the rows set in lines from a column, shifting the rest down */
+static uint64_t remove_lines(uint64_t col, uint64_t lines) {
+	while (lines != 0) {
+		int row = 63 - __builtin_clzll(lines);
+		uint64_t below = (1ULL << row) - 1;
+		col = (col & below) | ((col >> 1) & ~below);
+		lines &= below;
+	}
+	return col;
+}
+
+/* the bumpiness and wells of a surface, which hang on every column at once */
+static void surface(const int8_t *heights, int *bumpiness, int *wells) {
+	*bumpiness = *wells = 0;
+	for (int col = 0; col < GRID_WIDTH; ++col) {
+		if (col > 0) {
+			int step = heights[col] - heights[col - 1];
+			*bumpiness += step < 0 ? -step : step;
+		}
+		int left = col > 0 ? heights[col - 1] : GRID_HEIGHT;
+		int right = col < GRID_WIDTH - 1 ? heights[col + 1] : GRID_HEIGHT;
+		int rim = left < right ? left : right;
+		if (rim > heights[col]) {
+			*wells += rim - heights[col];
+		}
+	}
+}
+
+/* the cells of a piece, by column and by row, and which rows it touches */
+static uint64_t piece_cells(const struct tetrimino *piece, uint64_t *cols, uint16_t *rows) {
+	uint64_t touched = 0;
+	for (size_t i = 0; i < 4; ++i) {
+		int x = piece->minos[i].x + piece->pos_x;
+		int y = piece->minos[i].y + piece->pos_y;
+		cols[x] |= 1ULL << y;
+		rows[y] |= 1 << x;
+		touched |= 1ULL << y;
+	}
+	return touched;
+}
+
+void gf_init(struct grid_features *gf, const struct tetris_grid *grid) {
+	memset(gf, 0, sizeof(*gf));
+	memcpy(gf->rows, grid->rows, sizeof(gf->rows));
+	for (int row = 0; row < GRID_HEIGHT; ++row) {
+		for (uint16_t cells = grid->rows[row]; cells != 0; cells &= cells - 1) {
+			gf->cols[__builtin_ctz(cells)] |= 1ULL << row;
+		}
+		gf->row_transitions[row] = row_transitions(grid->rows[row]);
+		gf->totals[GF_ROW_TRANSITIONS] += gf->row_transitions[row];
+	}
+	int8_t heights[GRID_WIDTH];
+	for (int col = 0; col < GRID_WIDTH; ++col) {
+		struct gf_column stats = column_stats(gf->cols[col]);
+		gf->columns[col] = stats;
+		heights[col] = stats.height;
+		gf->totals[GF_HEIGHT] += stats.height;
+		gf->totals[GF_HOLES] += stats.holes;
+		gf->totals[GF_COVERED] += stats.covered;
+		gf->totals[GF_COL_TRANSITIONS] += stats.transitions;
+	}
+	surface(heights, &gf->totals[GF_BUMPINESS], &gf->totals[GF_WELLS]);
+}
+
+int gf_lock(struct grid_features *gf, const struct tetrimino *piece) {
+	uint64_t cols[GRID_WIDTH] = { 0 };
+	uint16_t rows[GRID_HEIGHT] = { 0 };
+	uint64_t touched = piece_cells(piece, cols, rows);
+
+	/* the rows the piece lands in, full ones going to 0 transitions */
+	uint64_t lines = 0;
+	for (uint64_t left = touched; left != 0; left &= left - 1) {
+		int row = __builtin_ctzll(left);
+		gf->rows[row] |= rows[row];
+		if (gf->rows[row] == GRID_FULL_ROW) {
+			lines |= 1ULL << row;
+		}
+		int transitions = row_transitions(gf->rows[row]);
+		gf->totals[GF_ROW_TRANSITIONS] += transitions - gf->row_transitions[row];
+		gf->row_transitions[row] = transitions;
+	}
+	/* top down, so the rows still to go keep their place */
+	for (uint64_t left = lines; left != 0; ) {
+		int row = 63 - __builtin_clzll(left);
+		left &= ~(1ULL << row);
+		memmove(gf->rows + row, gf->rows + row + 1, sizeof(gf->rows[0]) * (GRID_HEIGHT - 1 - row));
+		memmove(gf->row_transitions + row, gf->row_transitions + row + 1,
+				sizeof(gf->row_transitions[0]) * (GRID_HEIGHT - 1 - row));
+		gf->rows[GRID_HEIGHT - 1] = 0;
+		gf->row_transitions[GRID_HEIGHT - 1] = 0;
+	}
+
+	/* without a line clear only the columns the piece is in change */
+	int8_t heights[GRID_WIDTH];
+	for (int col = 0; col < GRID_WIDTH; ++col) {
+		uint64_t cells = remove_lines(gf->cols[col] | cols[col], lines);
+		if (cells != gf->cols[col]) {
+			struct gf_column stats = column_stats(cells);
+			struct gf_column *old = &gf->columns[col];
+			gf->totals[GF_HEIGHT] += stats.height - old->height;
+			gf->totals[GF_HOLES] += stats.holes - old->holes;
+			gf->totals[GF_COVERED] += stats.covered - old->covered;
+			gf->totals[GF_COL_TRANSITIONS] += stats.transitions - old->transitions;
+			*old = stats;
+			gf->cols[col] = cells;
+		}
+		heights[col] = gf->columns[col].height;
+	}
+	surface(heights, &gf->totals[GF_BUMPINESS], &gf->totals[GF_WELLS]);
+	int cleared = __builtin_popcountll(lines);
+	gf->totals[GF_LINES] += cleared;
+	return cleared;
+}
+
+void gf_delta(const struct grid_features *gf, const struct tetrimino *piece, int *delta) {
+	uint64_t cols[GRID_WIDTH] = { 0 };
+	uint16_t rows[GRID_HEIGHT] = { 0 };
+	uint64_t touched = piece_cells(piece, cols, rows);
+	memset(delta, 0, sizeof(int) * GF_COUNT);
+
+	/* rows the piece does not touch keep their transitions, wherever a
+	 * line clear moves them, and full rows have none */
+	uint64_t lines = 0;
+	for (uint64_t left = touched; left != 0; left &= left - 1) {
+		int row = __builtin_ctzll(left);
+		uint16_t cells = gf->rows[row] | rows[row];
+		if (cells == GRID_FULL_ROW) {
+			lines |= 1ULL << row;
+		}
+		delta[GF_ROW_TRANSITIONS] += row_transitions(cells) - gf->row_transitions[row];
+	}
+
+	int8_t heights[GRID_WIDTH];
+	for (int col = 0; col < GRID_WIDTH; ++col) {
+		heights[col] = gf->columns[col].height;
+		uint64_t cells = remove_lines(gf->cols[col] | cols[col], lines);
+		if (cells != gf->cols[col]) {
+			struct gf_column stats = column_stats(cells);
+			const struct gf_column *old = &gf->columns[col];
+			delta[GF_HEIGHT] += stats.height - old->height;
+			delta[GF_HOLES] += stats.holes - old->holes;
+			delta[GF_COVERED] += stats.covered - old->covered;
+			delta[GF_COL_TRANSITIONS] += stats.transitions - old->transitions;
+			heights[col] = stats.height;
+		}
+	}
+	int bumpiness, wells;
+	surface(heights, &bumpiness, &wells);
+	delta[GF_BUMPINESS] = bumpiness - gf->totals[GF_BUMPINESS];
+	delta[GF_WELLS] = wells - gf->totals[GF_WELLS];
+	delta[GF_LINES] = __builtin_popcountll(lines);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <inttypes.h>
+
+#include "grid.h"
+#include "tetrimino.h"
+
+/* board feature interface header
+ *
+ * evaluating a board means summarising its shape: how high the stack is,
+ * how many holes it has, how ragged its surface is. struct grid_features
+ * keeps those summaries for a grid and updates them as pieces lock, only
+ * looking again at the columns and rows a piece touched, and can tell what
+ * placing a piece would change without building the board it would leave.
+ *
+ * it tracks the grid's occupancy itself, so it is kept beside the grid it
+ * describes rather than in it, by whoever evaluates that grid.
+ */
+
+/* the features kept for a grid */
+enum grid_feature {
+	GF_HEIGHT = 0, /* the sum of the column heights */
+	GF_HOLES, /* the empty cells with a filled cell above */
+	GF_COVERED, /* the filled cells with a hole somewhere below */
+	GF_ROW_TRANSITIONS, /* the filled/empty changes along each non-empty row, walls filled */
+	GF_COL_TRANSITIONS, /* the filled/empty changes up each column below its top, floor filled */
+	GF_BUMPINESS, /* the sum of the height differences of neighbouring columns */
+	GF_WELLS, /* the sum of the depths of one column wide wells */
+	GF_LINES, /* the lines cleared */
+	GF_COUNT
+};
+
+/* what is known about one column */
+struct gf_column {
+	int8_t height, holes, covered, transitions;
+};
+
+struct grid_features {
+	/* the grid by column, row n in bit n, and by row, column n in bit n */
+	uint64_t cols[GRID_WIDTH];
+	uint16_t rows[GRID_HEIGHT];
+	struct gf_column columns[GRID_WIDTH];
+	int8_t row_transitions[GRID_HEIGHT];
+	/* every feature over the whole grid, by enum grid_feature. GF_LINES
+	 * counts the lines cleared since gf_init() */
+	int totals[GF_COUNT];
+};
+
+/* work out every feature of a grid from scratch */
+void gf_init(struct grid_features *, const struct tetris_grid *grid);
+
+/**
+ * gf_lock
+ * updates the features for a piece locking, and any lines it completes
+ * being cleared, as lockdown() and tg_clear_lines() do to the grid
+ * returns the number of lines cleared
+ */
+int gf_lock(struct grid_features *, const struct tetrimino *piece);
+
+/**
+ * gf_delta
+ * works out how locking a piece would change each feature, without
+ * changing anything, into delta indexed by enum grid_feature
+ */
+void gf_delta(const struct grid_features *, const struct tetrimino *piece, int *delta);
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h> /* getopt() */
+
+#include "eventlog.h"
+#include "event_queue.h"
+
+/* logdump prints an event log written by termtris -e, one record per line,
+ * or converts it to CSV for loading elsewhere.
+ *
+ * usage: logdump [-c] [-g game] log_file
+ *
+ * times are printed as wall-clock seconds since the epoch, using the
+ * offset in the LR_START record of each run. in CSV a run's row has the
+ * offset in the type column.
+ */
+
+/* the names of the engine phases, indexed by enum engine_phase */
+static const char *PHASE_NAMES[] = {
+	"generation", "falling", "lock", "pattern", "iterate", "animate",
+	"eliminate", "completion", "newgame", "gameover", "quitting",
+};
+#define PHASE_COUNT (sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]))
+
+static const char *KIND_NAMES[] = { "start", "event", "phase", "dropped" };
+#define KIND_COUNT (sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]))
+
+static const char * phase_name(uint8_t phase) {
+	return phase < PHASE_COUNT ? PHASE_NAMES[phase] : "?";
+}
+
+static const char * kind_name(uint8_t kind) {
+	return kind < KIND_COUNT ? KIND_NAMES[kind] : "?";
+}
+
+/* the name of what a record is about, its event or its new phase */
+static const char * type_name(const struct log_record *record) {
+	if (record->kind == LR_EVENT) {
+		const char *name = ge_name((enum game_event_type) record->type);
+		return name != NULL ? name : "?";
+	}
+	if (record->kind == LR_PHASE) {
+		return phase_name(record->type);
+	}
+	return "";
+}
+
+int main(int argc, char **argv) {
+	bool csv = false;
+	long game = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "cg:")) != -1) {
+		switch (opt) {
+			case 'c':
+				csv = true;
+				break;
+			case 'g':
+				game = strtol(optarg, NULL, 10);
+				break;
+			default:
+				error(1, 0, "usage: %s [-c] [-g game] log_file", argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		error(1, 0, "usage: %s [-c] [-g game] log_file", argv[0]);
+	}
+
+	FILE *file = fopen(argv[optind], "rb");
+	if (file == NULL) {
+		error(1, errno, "could not open %s", argv[optind]);
+	}
+	struct log_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != LOG_MAGIC) {
+		error(1, 0, "%s is not an event log", argv[optind]);
+	}
+	if (header.version != LOG_VERSION || header.record_size != sizeof(struct log_record)) {
+		error(1, 0, "%s is log version %u, this reader understands %d", argv[optind], header.version, LOG_VERSION);
+	}
+
+	if (csv) {
+		printf("realtime_ns,monotonic_ns,game,kind,type,phase\n");
+	}
+	uint64_t records = 0, runs = 0, dropped = 0;
+	int64_t offset = 0;
+	struct log_record record;
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		++records;
+		if (record.kind == LR_START) {
+			++runs;
+			offset = record.time;
+		} else if (record.kind == LR_DROPPED) {
+			dropped += record.game;
+		}
+		/* runs and drops are shown whichever game is asked for */
+		bool global = record.kind == LR_START || record.kind == LR_DROPPED;
+		if (game >= 0 && !global && record.game != (uint64_t) game) {
+			continue;
+		}
+		int64_t real = record.time + offset;
+		if (csv && record.kind == LR_START) {
+			/* a run has no time of its own, only the clock offset */
+			printf(",,,%s,%" PRId64 ",\n", kind_name(record.kind), offset);
+		} else if (csv) {
+			printf("%" PRId64 ",%" PRId64 ",%" PRIu32 ",%s,%s,%s\n", real, record.time, record.game,
+					kind_name(record.kind), type_name(&record), global ? "" : phase_name(record.phase));
+		} else if (record.kind == LR_START) {
+			printf("run started, wall clock is monotonic clock %+" PRId64 "ns\n", offset);
+		} else if (record.kind == LR_DROPPED) {
+			printf("%" PRId64 ".%09" PRId64 " dropped %" PRIu32 " records\n",
+					real / 1000000000L, real % 1000000000L, record.game);
+		} else {
+			printf("%" PRId64 ".%09" PRId64 " game %" PRIu32 " %s %s in %s\n",
+					real / 1000000000L, real % 1000000000L, record.game,
+					kind_name(record.kind), type_name(&record), phase_name(record.phase));
+		}
+	}
+	if (ferror(file)) {
+		error(1, errno, "could not read %s", argv[optind]);
+	}
+	fclose(file);
+	fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " runs, %" PRIu64 " dropped\n", records, runs, dropped);
+	return 0;
+}
@@ -1,328 +1,98 @@
 #include <locale.h>
 #include <stdlib.h>
 #include <error.h>
+#include <errno.h>
 #include <string.h>
-#include <curses.h>
+#include <stdbool.h>
+#include <inttypes.h>
 #include <time.h>
+#include <stdio.h> /* snprintf() and sscanf() */
+#include <limits.h> /* PATH_MAX */
+#include <unistd.h> /* getopt(), readlink() and execv() */
 
 #include "tetrimino.h"
-#include "bag.h"
 #include "grid.h"
 #include "event_queue.h"
 #include "state.h"
 #include "display.h"
-
-// TODO: standardize on one calling convention (out params, or return values or something)
-
-struct game_state {
-	/* the randomizer */
-	struct tetris_bag *bag;
-	/* the 10x40 play field grid */
-	struct tetris_grid grid;
-	/* the "current" piece */
-	struct tetrimino piece;
-	/* true if the current piece is valid */
-	bool piece_active;
-	/* current phase the tetris engine is in */
-	enum engine_phase phase;
-	/* true when the game is paused, false otherwise */
-	bool paused;
-	/* true when it's time for game to exit */
-	bool exiting;
-	/* the falling speed of blocks */
-	int64_t level;
-	/* state for marking which lines are to be deleted in the pattern phase */
-	unsigned long long int lines_marked : 40;
-	/* keeping things aligned */
-	int _padding:14;
-	/* the number of lines successfully cleared */
-	int64_t lines_cleared;
-	/* event queue - TODO: should this be part of the state? */
-	struct event_queue *events;
-	/* the nanotime since at which the game started */
-	int64_t start_time;
-	/* the nanotime since the most recent event processed */
-	int64_t now;
-};
-
-void phase_transition(struct game_state *state, enum engine_phase phase);
-
-void generate_piece(struct game_state *state);
-
-bool game_paused(const struct game_state *state) {
-	return state->paused;
-}
-
-const struct tetris_grid * game_grid(const struct game_state *state) {
-	return &state->grid;
-}
-
-bool valid_placement(const struct tetris_grid *grid, const struct tetrimino piece) {
-	bool result = TRUE;
-	for (size_t i=0; i<4; ++i) {
-		int x = (piece.minos[i].x + piece.pos_x);
-		int y = (piece.minos[i].y + piece.pos_y);
-		result = result &&
-			x >= 0 && x < GRID_WIDTH &&
-			y >=0 && y < GRID_HEIGHT &&
-			(tg_getcell(grid, x, y) == GC_EMPTY);
-	}
-	return result;
-}
-
-/* locks down a tetrimino, making it part of the grid */
-void lockdown(struct tetris_grid *grid, const struct tetrimino piece) {
-	for (size_t i=0; i<4; ++i) {
-		int x = (piece.minos[i].x + piece.pos_x);
-		int y = (piece.minos[i].y + piece.pos_y);
-		tg_setcell(grid, x, y, GC_FILL1);
-	}
-}
-
-void step_generation(struct game_state *state, const struct game_event *event);
-void step_falling(struct game_state *state, const struct game_event *event);
-void step_lock(struct game_state *state, const struct game_event *event);
-void step_pattern(struct game_state *state, const struct game_event *event);
-void step_iterate(struct game_state *state, const struct game_event *event);
-void step_animate(struct game_state *state, const struct game_event *event);
-void step_eliminate(struct game_state *state, const struct game_event *event);
-void step_completion(struct game_state *state, const struct game_event *event);
-
-void (*phase_handlers[NUM_ENGINE_PHASES])(struct game_state *state, const struct game_event *event) = {
-	step_generation,
-	step_falling,
-	step_lock,
-	step_pattern,
-	step_iterate,
-	step_animate,
-	step_eliminate,
-	step_completion,
-
-	0,0,0
-};
-
-void game_step(struct game_state *state, const struct game_event *event) {
-	if (phase_handlers[state->phase] != NULL) {
-		phase_handlers[state->phase](state, event);
-	}
-
-	/* TODO: don't special case this, move logic into phase handler for newgame */
-	if (event->type == GE_NEWGAME) {
-		eq_clear(state->events); 
-		phase_transition(state, EP_GENERATION);
-	}
-
-	/* respond to player input */
-	if (state->piece_active) {
-		switch (event->type) {
-			case GE_LSHIFT:
-				state->piece.pos_x--;
-				if (!valid_placement(&state->grid, state->piece)) {
-					state->piece.pos_x++;
-				}
-				break;
-			case GE_RSHIFT:
-				state->piece.pos_x++;
-				if (!valid_placement(&state->grid, state->piece)) {
-					state->piece.pos_x--;
-				}
-				break;
-			case GE_CWROTATE:
-				{
-					/* TODO: generate kick translations and sequentially test */
-					struct tetrimino potential = tet_rotate_cw(state->piece);
-					if (valid_placement(&state->grid, potential)) {
-						state->piece = potential;
-					}
-				}
-				break;
-			case GE_CCWROTATE:
-				{
-					/* TODO: generate kick translations and sequentially test */
-					struct tetrimino potential = tet_rotate_ccw(state->piece);
-					if (valid_placement(&state->grid, potential)) {
-						state->piece = potential;
-					}
-				}
-				break;
-			case GE_HARDDROP:
-				while (valid_placement(&state->grid, state->piece)) {
-					state->piece.pos_y--;
-				}
-				state->piece.pos_y++;
-				/* TODO: replace with a transition to the lockdown state */
-				phase_transition(state, EP_PATTERN);
-				break;
-			case GE_SOFTDROP:
-				state->piece.pos_y--;
-				if (!valid_placement(&state->grid, state->piece)) {
-					state->piece.pos_y++;
-					/* TODO: transition to lockdown state instead */
-					phase_transition(state, EP_PATTERN);
-				}
-				break;
-			case GE_PAUSE:
-				if (state->paused == TRUE) {
-					state->paused = FALSE;
-				} else {
-					state->paused = TRUE;
-				}
-				break;
-			default:
-				break;
-		}
+#include "shm.h"
+#include "server.h"
+#include "spectate.h"
+#include "record.h"
+#include "eventlog.h"
+
+int event_for_key(struct game_event *event, int key, bool holds);
+
+/* the most input events applied per wakeup, the rest wait for the next */
+#define INPUT_BATCH 64
+
+/* boards of other sizes are other builds, named termtris-WIDTHxHEIGHT for
+ * their Matrix and kept next to this one, see the Makefile. unless board
+ * names the size this build plays, run that build in place of this one
+ * with the same arguments */
+static void select_board(const char *board, char **argv) {
+	int width, height;
+	if (sscanf(board, "%dx%d", &width, &height) != 2) {
+		error(1, 0, "board sizes are WIDTHxHEIGHT, like %dx%d", GRID_WIDTH, GRID_HEIGHT / 2);
 	}
-
-	/* update the event */
-	if (event->time > state->now) {
-		state->now = event->time;
+	if (width == GRID_WIDTH && height == GRID_HEIGHT / 2) {
+		return;
 	}
-}
-
-int64_t now64() {
-	struct timespec spec;
-	clock_gettime(CLOCK_MONOTONIC, &spec);
-	return spec.tv_sec * 1000000000L + spec.tv_nsec;
-}
-
-/* initializes a game state structure. returns 0 on success */
-int game_init(struct game_state *state) {
-	if (state == NULL) {
-		return -1;
+	char self[PATH_MAX], path[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (len < 0) {
+		error(1, errno, "could not find this program");
 	}
-	tg_clear(&state->grid); /* clear grid */
-	state->bag = create_bag(1); /*initialize bag */
-	state->events = create_eq(); /* initialize event queue */
-
-	state->now = state->start_time = now64();
-
-	state->phase = EP_NEWGAME;
-	state->piece_active = FALSE;
-	state->paused = FALSE;
-	state->exiting = FALSE; /* TODO: do I need this? */
-	state->level = 0;
-	state->lines_cleared = 0;
-
-	return 0;
+	self[len] = '\0';
+	char *slash = strrchr(self, '/');
+	snprintf(path, sizeof(path), "%.*s/termtris-%dx%d", (int) (slash - self), self, width, height);
+	execv(path, argv);
+	error(1, errno, "no build for a %dx%d board at %s", width, height, path);
 }
 
-/* STEP HANDLERS */
-/* This is where the meat of the state transition flow goes */
-
-void step_generation(struct game_state *state, const struct game_event *event) {
-	if (event->type == GE_ENTER) {
-		state->piece = TETRIMINOS[bag_pull(state->bag)];
-		/* if there is a piece in the way of generation, the game is over */
-		if (!valid_placement(&state->grid, state->piece)) {
-			phase_transition(state, EP_GAMEOVER);
-		} else {
-			phase_transition(state, EP_FALLING);
-		}
-	} else {
-		// TODO: handle other types of events here
-		// user input events should probably be buffered
+/* hand an event to the game, keeping it in the recording if it was taken */
+static void push_input(struct game_state *state, struct recorder *rec, struct game_event event) {
+	if (game_push_event(state, event) && rec != NULL) {
+		record_event(rec, &event);
 	}
 }
 
-void step_falling(struct game_state *state, const struct game_event *event) {
-	/* attempt to fall once */
-	/* if successful */
-	if (event->type == GE_ENTER) {
-		state->piece_active = TRUE;
-		state->piece.pos_y--;
-		if (!valid_placement(&state->grid, state->piece)) {
-			state->piece.pos_y++;
-			phase_transition(state, EP_LOCK);
-			return;
-		}
-		struct game_event next_fall = {
-			.type = GE_ENTER,
-			.time = event->time + 1000000000L // TODO: use the level speed
-		};
-		eq_push(state->events, next_fall);
-	}
-}
-
-void step_lock(struct game_state *state, const struct game_event *event) {
-	if (event->type == GE_ENTER) {
-		struct game_event lockdown = {
-			.type = GE_LOCKDOWN,
-			.time = event->time + 500000000L // TODO: use the lock delay
-		};
-		eq_push(state->events, lockdown);
-	} else if (event->type == GE_LOCKDOWN) {
-		phase_transition(state, EP_PATTERN);
-	}
-}
-
-void step_pattern(struct game_state *state, const struct game_event *event) {
-	state->piece_active = FALSE;
-	lockdown(&state->grid, state->piece);
-	state->lines_marked = 0;
-	for (int row = 0; row < GRID_HEIGHT; ++row) {
-		bool good = true;
-		for (int col = 0; col < GRID_WIDTH; ++col) {
-			good = good && tg_getcell(&state->grid, col, row) != GC_EMPTY;
-		}
-		state->lines_marked |= ((unsigned int)good) << row;
+/* apply a batch of input, minus whatever would have made no difference */
+static void apply_input(struct game_state *state, struct recorder *rec, struct game_event *events, size_t n) {
+	n = game_coalesce(state, events, n);
+	game_step_many(state, events, n);
+	for (size_t i = 0; rec != NULL && i < n; ++i) {
+		record_event(rec, &events[i]);
 	}
-	phase_transition(state, EP_ITERATE);
-}
-void step_iterate(struct game_state *state, const struct game_event *event) {
-	phase_transition(state, EP_ANIMATE);
-}
-void step_animate(struct game_state *state, const struct game_event *event) {
-	phase_transition(state, EP_ELIMINATE);
-}
-void step_eliminate(struct game_state *state, const struct game_event *event) {
-	for (int row = 0; row < GRID_HEIGHT; ++row) {
-		if (state->lines_marked & (1 << row)) {
-			tg_rmline(&state->grid, row);
-		}
-	}
-	phase_transition(state, EP_COMPLETION);
-}
-void step_completion(struct game_state *state, const struct game_event *event) {
-	phase_transition(state, EP_GENERATION);
 }
 
-void phase_transition(struct game_state *state, enum engine_phase phase) {
-	struct game_event entrance = {
-		.type = GE_ENTER,
-		.time = state->now
-	};
-	state->phase = phase;
-	eq_clear(state->events);
-	eq_push(state->events, entrance);
-}
-
-void generate_piece(struct game_state *state) {
-	state->piece = TETRIMINOS[bag_pull(state->bag)];
-}
-
-int64_t game_next_event_time(const struct game_state *state) {
-	struct game_event peek;
-	if (eq_peek(state->events, &peek)) {
-		return peek.time;
-	}
-	return -1;
-}
-
-int event_for_key(struct game_event *event, int key);
-
-void game_loop(struct display *disp, struct game_state *state) {
+/* runs the game until exit. shm, pub and rec may be NULL if state export,
+ * spectating or recording are disabled */
+void game_loop(struct display *disp, struct game_state *state, struct shm_link *shm, struct spectate_pub *pub,
+		struct recorder *rec) {
 	struct game_event new_game_event = { .type = GE_NEWGAME, .time = now64() };
-	eq_push(state->events, new_game_event);
+	push_input(state, rec, new_game_event);
 	int64_t now = now64();
 	int64_t frame_count = 0;;
-	while(!state->exiting) {
+	struct game_event batch[INPUT_BATCH];
+	size_t pending;
+	while(!game_exiting(state)) {
 		++frame_count;
+		/* moves injected by external agents */
+		if (shm != NULL) {
+			pending = 0;
+			while (pending < INPUT_BATCH && shm_poll(shm, &batch[pending], now)) {
+				++pending;
+			}
+			apply_input(state, rec, batch, pending);
+		}
 		/* fast forward game state through event queue */
-		struct game_event peek;
-		while (eq_peek(state->events, &peek) && now >= peek.time) {
-			struct game_event pop;
-			eq_pop(state->events, &peek);
-			game_step(state, &peek);
+		game_advance(state, now);
+		if (shm != NULL) {
+			shm_publish(shm, state);
+		}
+		if (pub != NULL) {
+			spectate_publish(pub, state);
 		}
 		render_state(disp, state);
 
@@ -331,51 +101,53 @@ void game_loop(struct display *disp, struct game_state *state) {
 		now = now64();
 
 		int64_t next_event = game_next_event_time(state);
+		int wait_ms;
 		if (next_event == -1) {
-			timeout(16);
+			wait_ms = shm != NULL ? 1 : 16;
 		} else {
 			/* 60 fps */
 			int64_t next_thing = (last + 16666667L) > next_event ? (last + 16666667L) : next_event;
 			int64_t timeout_ns = next_thing - now;
 			if (timeout_ns < 0) { timeout_ns = 0; }
-			timeout(timeout_ns / 1000000L);
+			/* agents expect their moves to be picked up promptly */
+			if (shm != NULL && timeout_ns > 1000000L) { timeout_ns = 1000000L; }
+			wait_ms = timeout_ns / 1000000L;
 		}
 
-		int key = getch();
+		/* wait for a key, then take every other key already typed, so
+		 * that a burst of input costs one frame and not one per key.
+		 * input with no key in it is passed over by the display, so ERR
+		 * only ever means that nothing is left */
+		int key = display_read_key(disp, wait_ms);
 		// TODO: recreate display on terminal resizing events (KEY_RESIZE)
 		// TODO: handle timeouts nicely
-		struct game_event event = { .type = GE_NOOP, .time = now};
-		if (event_for_key(&event, key)) {
-			eq_push(state->events, event);
-		}
-		mvprintw(0,0,"key: %d\n", key);
-		printw("paused: %d\n", state->paused);
-		printw("frm: %ld\n", frame_count);
-		printw("phs: %ld\n", state->phase);
-		printw("qlen: %d\n", eq_len(state->events));
-		{
-			struct game_event peek;
-			if (eq_peek(state->events, &peek)) {
-				printw("event: %d\n", (int) peek.type);
+		pending = 0;
+		for (int next = key; next != ERR; ) {
+			batch[pending].type = GE_NOOP;
+			batch[pending].time = now;
+			if (event_for_key(&batch[pending], next, display_key_releases(disp))) {
+				++pending;
 			}
+			key = next;
+			next = pending < INPUT_BATCH ? display_read_key(disp, 0) : ERR;
 		}
+		apply_input(state, rec, batch, pending);
+		render_debug(disp, state, key, frame_count);
 	}
 }
 
-int64_t game_level(const struct game_state *state) {
-	return state->level;
-}
-int64_t game_lines_cleared(const struct game_state *state) {
-	return state->lines_cleared;
-}
-const struct event_queue * game_queue(const struct game_state *state) {
-	return state->events;
-}
-
-int event_for_key(struct game_event *event, int key) {
+/* holds is true if the display reports arrow keys being let go, so that
+ * the engine can repeat them itself instead of relying on the terminal */
+int event_for_key(struct game_event *event, int key, bool holds) {
 	switch (key) {
 		case ERR:
-			return FALSE;
+			return false;
+		case KEY_LEFT | DISPLAY_KEY_RELEASED:
+			event->type = GE_LRELEASE;
+			break;
+		case KEY_RIGHT | DISPLAY_KEY_RELEASED:
+			event->type = GE_RRELEASE;
+			break;
 		case KEY_UP:
 			event->type = GE_HARDDROP;
 			break;
@@ -383,7 +155,6 @@ int event_for_key(struct game_event *event, int key) {
 			event->type = GE_SOFTDROP;
 			break;
 		case 10:
-			mvprintw(1,0,"boop: %x\n", key);
 			event->type = GE_PAUSE;
 			break;
 		case 'z':
@@ -392,11 +163,18 @@ int event_for_key(struct game_event *event, int key) {
 		case 'x':
 			event->type = GE_CWROTATE;
 			break;
-		case KEY_LEFT: /* intentional fall-through */
+		case 'q':
+			event->type = GE_QUIT;
+			break;
+		case KEY_LEFT:
+			event->type = holds ? GE_LPRESS : GE_LSHIFT;
+			break;
+		case KEY_RIGHT:
+			event->type = holds ? GE_RPRESS : GE_RSHIFT;
+			break;
 		case 'j':
 			event->type = GE_LSHIFT;
 			break;
-		case KEY_RIGHT: /* intentional fall-through */
 		case 'k':
 			event->type = GE_RSHIFT;
 			break;
@@ -407,9 +185,10 @@ int event_for_key(struct game_event *event, int key) {
 			// TODO: output the missed key as debug
 			break;
 	}
-	return TRUE;
+	return true;
 }
 
+#ifndef TERMTRIS_NO_CURSES
 /* initialize all global ncurses-related setup */
 void init_ncurses() {
 	/* initialize locale for ncurses */
@@ -426,46 +205,168 @@ void init_ncurses() {
 
 	init_pair(1, COLOR_RED, COLOR_BLUE);
 	init_pair(2, COLOR_WHITE, COLOR_BLACK);
+	init_piece_colors();
 }
 
 /* terminate all global ncurses-related state */
 void term_ncurses() {
 	endwin();
 }
+#else
+void term_ncurses() {
+}
+#endif
 
 /* all main should do is initialize the display, input, and game state, and
  * then hand control to the game until it's time for the end */
-int main() {
+int main(int argc, char **argv) {
 	/* store the intermediate game state */
-	struct game_state state;
+	struct game_state *state;
 	/* store the ncurses display information */
 	struct display *disp;
+	/* optional shared memory state export */
+	const char *shm_path = NULL;
+	struct shm_link *shm = NULL;
+	/* server mode: where to listen and with how many reactor threads */
+	const char *serve_addr = NULL;
+	int serve_threads = 4;
+	/* spectating: where to broadcast this game, or which one to watch */
+	const char *publish_path = NULL;
+	const char *watch_path = NULL;
+	struct spectate_pub *pub = NULL;
+	/* optional recording of the game, for replaying it later */
+	const char *record_path = NULL;
+	struct recorder *rec = NULL;
+	/* optional binary log of everything the engine does */
+	const char *log_path = NULL;
+	struct event_log *log = NULL;
+	/* delayed auto shift and auto repeat rate for held arrow keys */
+	int64_t das = GAME_DEFAULT_DAS, arr = GAME_DEFAULT_ARR;
+	/* draw with raw escape sequences instead of ncurses */
+#ifndef TERMTRIS_NO_CURSES
+	bool ansi = false;
+#else
+	bool ansi = true;
+#endif
+
+	int opt;
+	while ((opt = getopt(argc, argv, "ab:s:l:t:p:w:r:D:R:e:")) != -1) {
+		switch (opt) {
+			case 'b':
+				select_board(optarg, argv);
+				break;
+			case 'a':
+				ansi = true;
+				break;
+			case 's':
+				shm_path = optarg;
+				break;
+			case 'l':
+				serve_addr = optarg;
+				break;
+			case 't':
+				serve_threads = atoi(optarg);
+				break;
+			case 'p':
+				publish_path = optarg;
+				break;
+			case 'w':
+				watch_path = optarg;
+				break;
+			case 'r':
+				record_path = optarg;
+				break;
+			case 'e':
+				log_path = optarg;
+				break;
+			case 'D':
+				das = atoi(optarg) * 1000000L;
+				break;
+			case 'R':
+				arr = atoi(optarg) * 1000000L;
+				break;
+			default:
+				error(1, 0, "usage: %s [-a] [-b board_size] [-s shm_file] [-p spectate_socket] [-r recording] [-e event_log] [-D das_ms] [-R arr_ms] [-l socket_path|port [-t threads]] [-w spectate_socket]", argv[0]);
+		}
+	}
+
+	if (das < 0 || das > GAME_MAX_AUTOSHIFT || arr < 0 || arr > GAME_MAX_AUTOSHIFT) {
+		error(1, 0, "DAS and ARR must be between 0 and %ld ms", GAME_MAX_AUTOSHIFT / 1000000L);
+	}
+
+	if (log_path != NULL && (log = create_event_log(log_path)) == NULL) {
+		error(1, errno, "could not open %s", log_path);
+	}
+
+	/* the server hosts headless games and never touches the terminal */
+	if (serve_addr != NULL) {
+		int status = run_server(serve_addr, serve_threads, log);
+		destroy_event_log(log);
+		return status;
+	}
 
-	/* initialize ncurses */
-	init_ncurses();
+	if (shm_path != NULL && (shm = create_shm_link(shm_path)) == NULL) {
+		error(1, errno, "could not map %s", shm_path);
+	}
+	if (publish_path != NULL && (pub = create_spectate_pub(publish_path)) == NULL) {
+		error(1, errno, "could not listen on %s", publish_path);
+	}
+	/* the seed is fixed for now, see create_game() below */
+	if (record_path != NULL && (rec = create_recorder(record_path, 1, das, arr)) == NULL) {
+		error(1, errno, "could not write %s", record_path);
+	}
 
 	/* initialize screen */
-	if ((disp = create_display(stdscr, GRID_WIDTH, GRID_VISIBLE_HEIGHT)) == NULL) {
+	if (ansi) {
+		disp = create_ansi_display(STDIN_FILENO, STDOUT_FILENO, GRID_WIDTH, GRID_VISIBLE_HEIGHT);
+	}
+#ifndef TERMTRIS_NO_CURSES
+	else {
+		/* initialize ncurses */
+		init_ncurses();
+		disp = create_display(stdscr, GRID_WIDTH, GRID_VISIBLE_HEIGHT);
+	}
+#endif
+	if (disp == NULL) {
 		// TODO report error here
 		return 1;
 	}
 
+	/* viewers only draw someone else's game */
+	if (watch_path != NULL) {
+		int status = spectate_view(watch_path, disp);
+		destroy_display(disp);
+		if (!ansi) {
+			term_ncurses();
+		}
+		if (status != 0) {
+			error(1, errno, "could not watch %s", watch_path);
+		}
+		return 0;
+	}
+
 	/* initialize the game state */
-	if (game_init(&state) != 0) {
+	if ((state = create_game(1)) == NULL) {
 		return 1;
 	}
+	game_set_autoshift(state, das, arr);
+	game_set_log(state, log, 0);
+	game_set_lock_observer(state, display_lock, disp);
 
 	/* enter the main game event loop */
-	game_loop(disp, &state);
+	game_loop(disp, state, shm, pub, rec);
+	if (rec != NULL) {
+		record_end(rec, state);
+	}
 
 	destroy_display(disp); /* deinitialize screen */
-	term_ncurses(); /* peace out */
-	return 0;
-}
-
-const struct tetrimino * game_piece(const struct game_state *state) {
-	if (!state->piece_active) {
-		return NULL;
+	destroy_game(state);
+	destroy_shm_link(shm);
+	destroy_spectate_pub(pub);
+	destroy_recorder(rec);
+	destroy_event_log(log);
+	if (!ansi) {
+		term_ncurses(); /* peace out */
 	}
-	return &state->piece;
+	return 0;
 }
@@ -0,0 +1,264 @@
+#include <stdbool.h>
+#include <string.h> /* memset() */
+
+#include "movegen.h"
+#include "placement.h"
+#include "event_queue.h" /* the keys of a path */
+
+bool spawn_piece(const struct tetris_grid *grid, enum tetrimino_type type, struct tetrimino *out) {
+	struct tetrimino piece = TETRIMINOS[type];
+	if (!valid_placement(grid, piece)) {
+		return false;
+	}
+	/* entering the falling phase drops the piece one row straight away */
+	piece.pos_y--;
+	if (!valid_placement(grid, piece)) {
+		piece.pos_y++;
+	}
+	*out = piece;
+	return true;
+}
+
+uint64_t piece_signature(const struct tetrimino *piece) {
+	int min_x = piece->minos[0].x, min_y = piece->minos[0].y;
+	for (int i = 1; i < 4; ++i) {
+		min_x = piece->minos[i].x < min_x ? piece->minos[i].x : min_x;
+		min_y = piece->minos[i].y < min_y ? piece->minos[i].y : min_y;
+	}
+	/* the bottom row and the leftmost column, then the cells in the 4 by 4
+	 * square from there, so that it holds for any width of grid */
+	uint64_t sig = (uint64_t) (uint8_t) (piece->pos_y + min_y) << 24 | (uint64_t) (uint8_t) (piece->pos_x + min_x) << 16;
+	for (int i = 0; i < 4; ++i) {
+		sig |= 1ULL << ((piece->minos[i].y - min_y) * 4 + piece->minos[i].x - min_x);
+	}
+	return sig;
+}
+
+/* add a move to out unless an earlier one locks the same cells */
+static int add_move(struct tetrimino piece, int rotation, int shift, struct move *out, uint64_t *sigs, int count) {
+	uint64_t sig = piece_signature(&piece);
+	for (int i = 0; i < count; ++i) {
+		if (sigs[i] == sig) {
+			return count;
+		}
+	}
+	sigs[count] = sig;
+	out[count].piece = piece;
+	out[count].rotation = (int8_t) rotation;
+	out[count].shift = (int8_t) shift;
+	return count + 1;
+}
+
+/* the number of set bits in mask from bit first on, stopping at n */
+static int fitting_run(const uint64_t *mask, size_t first, int n) {
+	int run = 0;
+	while (run < n) {
+		size_t i = first + run;
+		uint64_t gaps = ~mask[i / 64] >> (i % 64);
+		if (gaps != 0) {
+			run += __builtin_ctzll(gaps);
+			break;
+		}
+		run += 64 - (int) (i % 64);
+	}
+	return run < n ? run : n;
+}
+
+/* add the moves of one orientation: shifted from where it starts along its
+ * row until something is in the way, then hard dropped. every position the
+ * piece could take between its row and the floor is tested in one batch,
+ * each column's rows consecutive from the top, so that both the shifts and
+ * the drops are read off the mask */
+static int add_orientation(const struct tetris_grid *grid, const struct tetrimino *start, int rotation,
+		struct move *out, uint64_t *sigs, int count) {
+	int min_x = start->minos[0].x, max_x = min_x, min_y = start->minos[0].y;
+	for (int i = 1; i < 4; ++i) {
+		min_x = start->minos[i].x < min_x ? start->minos[i].x : min_x;
+		max_x = start->minos[i].x > max_x ? start->minos[i].x : max_x;
+		min_y = start->minos[i].y < min_y ? start->minos[i].y : min_y;
+	}
+	/* the columns and rows the piece is on the grid at */
+	int first_x = -min_x, columns = GRID_WIDTH - (max_x - min_x);
+	int rows = start->pos_y + min_y + 1;
+	struct placement candidates[GRID_WIDTH * GRID_HEIGHT];
+	uint64_t mask[(GRID_WIDTH * GRID_HEIGHT + 63) / 64];
+	for (int c = 0; c < columns; ++c) {
+		for (int r = 0; r < rows; ++r) {
+			candidates[c * rows + r] = (struct placement) {
+				.type = (uint8_t) start->type, .rs = (uint8_t) start->rs,
+				.x = (int8_t) (first_x + c), .y = (int8_t) (start->pos_y - r),
+			};
+		}
+	}
+	valid_placements(grid, candidates, (size_t) (columns * rows), mask);
+
+	/* the start, then shifts left, then shifts right */
+	int home = start->pos_x - first_x;
+	for (int dir = 0; dir <= 1; ++dir) {
+		for (int c = dir == 0 ? home : home + 1; c >= 0 && c < columns; c += dir == 0 ? -1 : 1) {
+			int drop = fitting_run(mask, (size_t) (c * rows), rows);
+			if (drop == 0) {
+				break;
+			}
+			struct tetrimino piece = *start;
+			piece.pos_x = (int8_t) (first_x + c);
+			piece.pos_y = (int8_t) (start->pos_y - (drop - 1));
+			count = add_move(piece, rotation, piece.pos_x - start->pos_x, out, sigs, count);
+		}
+	}
+	return count;
+}
+
+int generate_moves(const struct tetris_grid *grid, enum tetrimino_type type, struct move *out) {
+	struct tetrimino spawn;
+	if (!spawn_piece(grid, type, &spawn)) {
+		return 0;
+	}
+
+	/* the orientations reachable by rotating in place, each turn must fit */
+	struct tetrimino turned[4];
+	int rotations[4];
+	int orientations = 0;
+	turned[orientations] = spawn;
+	rotations[orientations++] = 0;
+	struct tetrimino cw = tet_rotate_cw(spawn);
+	if (valid_placement(grid, cw)) {
+		turned[orientations] = cw;
+		rotations[orientations++] = 1;
+	}
+	struct tetrimino ccw = tet_rotate_ccw(spawn);
+	if (valid_placement(grid, ccw)) {
+		turned[orientations] = ccw;
+		rotations[orientations++] = -1;
+	}
+	struct tetrimino half = tet_rotate_cw(cw);
+	if ((valid_placement(grid, cw) || valid_placement(grid, ccw)) && valid_placement(grid, half)) {
+		turned[orientations] = half;
+		rotations[orientations++] = 2;
+	}
+
+	uint64_t sigs[MAX_MOVES];
+	int count = 0;
+	for (int o = 0; o < orientations; ++o) {
+		count = add_orientation(grid, &turned[o], rotations[o], out, sigs, count);
+	}
+	return count;
+}
+
+/* pack a search state, see struct path_search */
+static inline uint16_t pack_state(int rs, int x, int y) {
+	return (uint16_t) ((rs * GRID_HEIGHT + y) * GRID_WIDTH + x);
+}
+
+/* fill in where each rotation of a piece fits, a row of origins at a time:
+ * bit x survives if the cell each mino would cover from there is free */
+static void find_fits(const struct tetris_grid *grid, const struct tetrimino *rotations, uint16_t fits[4][GRID_HEIGHT]) {
+	for (int rs = 0; rs < 4; ++rs) {
+		for (int y = 0; y < GRID_HEIGHT; ++y) {
+			uint16_t fit = GRID_FULL_ROW;
+			for (int i = 0; i < 4 && fit != 0; ++i) {
+				int mx = rotations[rs].minos[i].x, row = y + rotations[rs].minos[i].y;
+				if (row < 0 || row >= GRID_HEIGHT) {
+					fit = 0;
+					break;
+				}
+				uint16_t free = ~grid->rows[row] & GRID_FULL_ROW;
+				fit &= mx >= 0 ? free >> mx : free << -mx;
+			}
+			fits[rs][y] = fit & GRID_FULL_ROW;
+		}
+	}
+}
+
+/* reach a state from the one at index parent with key, unless it has been
+ * reached already */
+static inline void visit(struct path_search *search, int rs, int x, int y, int parent, enum game_event_type key) {
+	if (search->visited[rs][y] & (1 << x)) {
+		return;
+	}
+	search->visited[rs][y] |= 1 << x;
+	int i = search->state_count++;
+	search->states[i] = pack_state(rs, x, y);
+	search->parents[i] = (uint16_t) parent;
+	search->keys[i] = (uint8_t) key;
+	search->depths[i] = search->depths[parent] + 1;
+}
+
+int find_paths(const struct tetris_grid *grid, enum tetrimino_type type, struct path_search *search) {
+	search->state_count = search->path_count = 0;
+	struct tetrimino spawn;
+	if (!spawn_piece(grid, type, &spawn)) {
+		return 0;
+	}
+	struct tetrimino rotations[4];
+	rotations[RS_NORTH] = spawn;
+	for (int rs = 1; rs < 4; ++rs) {
+		rotations[rs] = tet_rotate_cw(rotations[rs - 1]);
+	}
+	find_fits(grid, rotations, search->fits);
+	memset(search->visited, 0, sizeof(search->visited));
+	uint16_t locked[4][GRID_HEIGHT] = { { 0 } };
+
+	search->visited[RS_NORTH][spawn.pos_y] = 1 << spawn.pos_x;
+	search->states[0] = pack_state(RS_NORTH, spawn.pos_x, spawn.pos_y);
+	search->parents[0] = 0;
+	search->depths[0] = 0;
+	search->state_count = 1;
+	/* states come off the queue fewest keys first, so the first path to
+	 * any lock position is a shortest one */
+	for (int head = 0; head < search->state_count; ++head) {
+		int x = search->states[head] % GRID_WIDTH;
+		int y = search->states[head] / GRID_WIDTH % GRID_HEIGHT;
+		int rs = search->states[head] / (GRID_WIDTH * GRID_HEIGHT);
+		const uint16_t *fits = search->fits[rs];
+
+		int drop = y;
+		while (drop > 0 && (fits[drop - 1] & (1 << x))) {
+			--drop;
+		}
+		if (!(locked[rs][drop] & (1 << x))) {
+			locked[rs][drop] |= 1 << x;
+			struct tetrimino piece = rotations[rs];
+			piece.pos_x = (int8_t) x;
+			piece.pos_y = (int8_t) drop;
+			uint64_t sig = piece_signature(&piece);
+			bool seen = false;
+			for (int i = 0; i < search->path_count && !seen; ++i) {
+				seen = search->signatures[i] == sig;
+			}
+			if (!seen) {
+				struct path *path = &search->paths[search->path_count];
+				search->signatures[search->path_count++] = sig;
+				path->piece = piece;
+				path->length = search->depths[head] + 1;
+				path->from = (uint16_t) head;
+			}
+		}
+
+		if (x > 0 && (fits[y] & (1 << (x - 1)))) {
+			visit(search, rs, x - 1, y, head, GE_LSHIFT);
+		}
+		if (fits[y] & (1 << (x + 1))) {
+			visit(search, rs, x + 1, y, head, GE_RSHIFT);
+		}
+		if (search->fits[(rs + 1) & 3][y] & (1 << x)) {
+			visit(search, (rs + 1) & 3, x, y, head, GE_CWROTATE);
+		}
+		if (search->fits[(rs + 3) & 3][y] & (1 << x)) {
+			visit(search, (rs + 3) & 3, x, y, head, GE_CCWROTATE);
+		}
+		if (y > 0 && (fits[y - 1] & (1 << x))) {
+			visit(search, rs, x, y - 1, head, GE_SOFTDROP);
+		}
+	}
+	return search->path_count;
+}
+
+void path_keys(const struct path_search *search, int index, uint8_t *keys) {
+	const struct path *path = &search->paths[index];
+	keys[path->length - 1] = GE_HARDDROP;
+	int i = path->length - 1;
+	for (int state = path->from; state != 0; state = search->parents[state]) {
+		keys[--i] = search->keys[state];
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "grid.h"
+#include "tetrimino.h"
+
+/* move generation interface header */
+
+/* more than the number of distinct placements any piece can have */
+#define MAX_MOVES 64
+
+/* one way to place a piece */
+struct move {
+	/* the piece where it locks */
+	struct tetrimino piece;
+	/* the quarter turns clockwise made at spawn: -1, 0, 1 or 2 */
+	int8_t rotation;
+	/* the columns shifted after rotating, negative being left */
+	int8_t shift;
+};
+
+/* the piece as the engine first lets the player move it, or false if it
+ * cannot spawn because the grid is topped out */
+bool spawn_piece(const struct tetris_grid *grid, enum tetrimino_type type, struct tetrimino *out);
+
+/**
+ * generate_moves
+ * finds every distinct lock position reachable by rotating at spawn,
+ * shifting and hard dropping. two moves that lock the same cells count once
+ * returns the number written to out, 0 if the piece cannot spawn
+ */
+int generate_moves(const struct tetris_grid *grid, enum tetrimino_type type, struct move *out);
+
+/* a value identifying the cells a piece covers, equal for equal cells */
+uint64_t piece_signature(const struct tetrimino *piece);
+
+/* PATHFINDING
+ *
+ * find_paths() searches breadth first over every state (rotation, x, y) a
+ * piece can be moved through with the keys game_step() handles: shifts,
+ * rotations in place and soft drops of one row. it finds every lock
+ * position a hard drop from one of those states reaches, tucks and spins
+ * included, with the fewest keys that get there. gravity is taken not to
+ * act between keys.
+ *
+ * the origin of every piece is one of its cells, so a piece on the grid
+ * can only be in 4 * GRID_WIDTH * GRID_HEIGHT states.
+ */
+
+/* the most states, and so lock positions, a search can find */
+#define PATH_MAX_STATES (4 * GRID_WIDTH * GRID_HEIGHT)
+
+/* a lock position the pathfinder found */
+struct path {
+	/* the piece where it locks */
+	struct tetrimino piece;
+	/* the number of keys that get it there, the hard drop included */
+	uint16_t length;
+	/* the search state it is hard dropped from */
+	uint16_t from;
+};
+
+/* the working space and results of a search, around 64KB, so callers keep
+ * one around rather than putting it on the stack of every call */
+struct path_search {
+	/* bit x of fits[rs][y] is set if the piece fits with its origin at
+	 * (x, y) in rotation state rs, and likewise for the states visited */
+	uint16_t fits[4][GRID_HEIGHT];
+	uint16_t visited[4][GRID_HEIGHT];
+	/* the states reached in the order reached, each packed as
+	 * (rs * GRID_HEIGHT + y) * GRID_WIDTH + x, with the state it was
+	 * reached from, the key that did it and the keys pressed so far */
+	uint16_t states[PATH_MAX_STATES];
+	uint16_t parents[PATH_MAX_STATES];
+	uint8_t keys[PATH_MAX_STATES];
+	uint16_t depths[PATH_MAX_STATES];
+	int state_count;
+	/* the distinct lock positions found, fewest keys first */
+	struct path paths[PATH_MAX_STATES];
+	uint64_t signatures[PATH_MAX_STATES];
+	int path_count;
+};
+
+/**
+ * find_paths
+ * finds every lock position a piece can reach from where it spawns. two
+ * positions covering the same cells count once, with the shorter path
+ * returns the number of paths in search->paths, 0 if the piece cannot spawn
+ */
+int find_paths(const struct tetris_grid *grid, enum tetrimino_type type, struct path_search *search);
+
+/* write the keys of search->paths[index], as enum game_event_types ending
+ * in GE_HARDDROP, to keys, which must hold its length */
+void path_keys(const struct path_search *search, int index, uint8_t *keys);
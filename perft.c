@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h> /* getopt() and sysconf() */
+#include <pthread.h>
+
+#include "grid.h"
+#include "bag.h"
+#include "tetrimino.h"
+#include "placement.h"
+#include "movegen.h"
+#include "state.h" /* now64() */
+
+/* perft counts the lock positions reachable from a board for a fixed piece
+ * sequence, to a given depth. the counts pin down move generation, and the
+ * time taken is a fixed workload for comparing engine builds.
+ *
+ * usage: perft [-t] [-s seed] [-j threads] [-b board_file] depth
+ *
+ * with -t every lock position the pathfinder reaches counts, tucks and
+ * spins included, rather than only those generate_moves() finds.
+ *
+ * the board file holds up to GRID_HEIGHT lines of up to GRID_WIDTH '.'
+ * (empty) and anything else (filled), top line first, bottom line being
+ * row 0.
+ *
+ * known counts on an empty board:
+ *   seed 1 (O I S T): perft(3) = 2601, perft(4) = 88434
+ *   seed 7 (T O L J): perft(3) = 10404, perft(4) = 353736
+ * and with -t:
+ *   seed 1: perft(3) = 2669, perft(4) = 96414
+ *   seed 7: perft(3) = 10708, perft(4) = 384489
+ */
+
+/* the longest piece sequence supported */
+#define PERFT_MAX_DEPTH 32
+
+/* the work shared by all threads for one depth */
+struct perft_job {
+	struct tetris_grid root;
+	uint8_t sequence[PERFT_MAX_DEPTH];
+	int depth;
+	/* true to count every position find_paths() reaches */
+	bool tucks;
+	/* where the root's piece locks, handed out to threads one at a time */
+	struct tetrimino moves[PATH_MAX_STATES];
+	int move_count;
+	atomic_int next_move;
+	/* totals over all threads */
+	atomic_uint_fast64_t leaves;
+	atomic_uint_fast64_t nodes;
+};
+
+/* where a piece can lock on a grid: generate_moves(), or with a search the
+ * paths it finds, in which case a piece is search->paths[i].piece */
+static int lock_positions(const struct tetris_grid *grid, enum tetrimino_type type, struct move *moves,
+		struct path_search *search) {
+	return search != NULL ? find_paths(grid, type, search) : generate_moves(grid, type, moves);
+}
+
+/* count the leaves below a grid with depth pieces left to place, adding
+ * every position visited to nodes. searches, if not NULL, has one search
+ * per depth left */
+static uint64_t perft(const struct tetris_grid *grid, const uint8_t *sequence, int depth, uint64_t *nodes,
+		struct path_search *searches) {
+	struct move moves[MAX_MOVES];
+	int count = lock_positions(grid, (enum tetrimino_type) sequence[0], moves, searches);
+	*nodes += count;
+	if (depth == 1) {
+		return count;
+	}
+	uint64_t leaves = 0;
+	for (int i = 0; i < count; ++i) {
+		struct tetris_grid child = *grid;
+		lockdown(&child, searches != NULL ? searches->paths[i].piece : moves[i].piece);
+		tg_clear_lines(&child);
+		leaves += perft(&child, sequence + 1, depth - 1, nodes, searches != NULL ? searches + 1 : NULL);
+	}
+	return leaves;
+}
+
+static void * perft_worker(void *arg) {
+	struct perft_job *job = (struct perft_job *) arg;
+	uint64_t leaves = 0, nodes = 0;
+	struct path_search *searches = NULL;
+	if (job->tucks && (searches = (struct path_search *) malloc(sizeof(struct path_search) * (job->depth - 1))) == NULL) {
+		error(1, 0, "out of memory");
+	}
+	int i;
+	while ((i = atomic_fetch_add(&job->next_move, 1)) < job->move_count) {
+		struct tetris_grid child = job->root;
+		lockdown(&child, job->moves[i]);
+		tg_clear_lines(&child);
+		leaves += perft(&child, job->sequence + 1, job->depth - 1, &nodes, searches);
+	}
+	free(searches);
+	atomic_fetch_add(&job->leaves, leaves);
+	atomic_fetch_add(&job->nodes, nodes);
+	return NULL;
+}
+
+/* run one depth across threads, the root's moves being the unit of work */
+static void perft_run(struct perft_job *job, int threads) {
+	atomic_store(&job->leaves, 0);
+	atomic_store(&job->nodes, 0);
+	atomic_store(&job->next_move, 0);
+	struct move moves[MAX_MOVES];
+	struct path_search *search = NULL;
+	if (job->tucks && (search = (struct path_search *) malloc(sizeof(struct path_search))) == NULL) {
+		error(1, 0, "out of memory");
+	}
+	job->move_count = lock_positions(&job->root, (enum tetrimino_type) job->sequence[0], moves, search);
+	for (int i = 0; i < job->move_count; ++i) {
+		job->moves[i] = search != NULL ? search->paths[i].piece : moves[i].piece;
+	}
+	free(search);
+	if (job->depth == 1) {
+		atomic_store(&job->leaves, job->move_count);
+		atomic_store(&job->nodes, job->move_count);
+		return;
+	}
+	atomic_store(&job->nodes, job->move_count);
+	pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+	for (int t = 0; t < threads; ++t) {
+		if (pthread_create(&workers[t], NULL, perft_worker, job) != 0) {
+			error(1, 0, "could not start worker thread");
+		}
+	}
+	for (int t = 0; t < threads; ++t) {
+		pthread_join(workers[t], NULL);
+	}
+	free(workers);
+}
+
+/* fill grid from a board file. a board wider or taller than the grid is
+ * refused rather than cut down to fit it */
+static void read_board(const char *path, struct tetris_grid *grid) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		error(1, errno, "could not open %s", path);
+	}
+	char lines[GRID_HEIGHT][GRID_WIDTH + 1];
+	/* room for far more than a row, so that a line too long for the grid
+	 * is seen whole rather than read as several */
+	char line[256];
+	int count = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		size_t len = strcspn(line, "\r\n");
+		if (len > GRID_WIDTH) {
+			error(1, 0, "%s:%d: wider than the %d column grid", path, count + 1, GRID_WIDTH);
+		}
+		if (count == GRID_HEIGHT) {
+			error(1, 0, "%s: taller than the %d row grid", path, GRID_HEIGHT);
+		}
+		memcpy(lines[count], line, len);
+		lines[count][len] = '\0';
+		++count;
+	}
+	fclose(file);
+	tg_clear(grid);
+	for (int i = 0; i < count; ++i) {
+		int row = count - 1 - i;
+		for (int col = 0; col < GRID_WIDTH && lines[i][col] != '\0'; ++col) {
+			if (lines[i][col] != '.') {
+				tg_setcell(grid, col, row, GC_FILL1);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned int seed = 1;
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	const char *board = NULL;
+	bool tucks = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "ts:j:b:")) != -1) {
+		switch (opt) {
+			case 't':
+				tucks = true;
+				break;
+			case 's':
+				seed = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'b':
+				board = optarg;
+				break;
+			default:
+				error(1, 0, "usage: %s [-t] [-s seed] [-j threads] [-b board_file] depth", argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		error(1, 0, "usage: %s [-t] [-s seed] [-j threads] [-b board_file] depth", argv[0]);
+	}
+	int depth = atoi(argv[optind]);
+	if (depth < 1 || depth > PERFT_MAX_DEPTH) {
+		error(1, 0, "depth must be between 1 and %d", PERFT_MAX_DEPTH);
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	struct perft_job *job = (struct perft_job *) malloc(sizeof(struct perft_job));
+	job->tucks = tucks;
+	if (board != NULL) {
+		read_board(board, &job->root);
+	} else {
+		tg_clear(&job->root);
+	}
+	/* the same pieces the game with this seed would deal */
+	struct tetris_bag bag;
+	bag_init(&bag, seed);
+	for (int i = 0; i < depth; ++i) {
+		job->sequence[i] = (uint8_t) bag_pull(&bag);
+	}
+
+	printf("seed %u, %d threads, %s, pieces", seed, threads, tucks ? "every reachable position" : "drops from spawn");
+	for (int i = 0; i < depth; ++i) {
+		printf(" %c", "IOJLSZT"[job->sequence[i]]);
+	}
+	printf("\n");
+	for (int d = 1; d <= depth; ++d) {
+		job->depth = d;
+		int64_t start = now64();
+		perft_run(job, threads);
+		double seconds = (now64() - start) / 1e9;
+		uint64_t nodes = atomic_load(&job->nodes);
+		printf("perft(%d) = %" PRIu64 "  nodes %" PRIu64 "  %.3fs  %.0f nodes/s\n",
+				d, (uint64_t) atomic_load(&job->leaves), nodes, seconds,
+				seconds > 0 ? nodes / seconds : 0.0);
+		fflush(stdout);
+	}
+	free(job);
+	return 0;
+}
@@ -0,0 +1,195 @@
+#include <string.h> /* memset */
+#include <pthread.h> /* pthread_once() */
+
+#include "placement.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLACEMENT_HAVE_AVX2 1
+#endif
+
+bool valid_placement(const struct tetris_grid *grid, const struct tetrimino piece) {
+	bool result = true;
+	for (size_t i=0; i<4; ++i) {
+		int x = (piece.minos[i].x + piece.pos_x);
+		int y = (piece.minos[i].y + piece.pos_y);
+		result = result &&
+			x >= 0 && x < GRID_WIDTH &&
+			y >=0 && y < GRID_HEIGHT &&
+			(tg_getcell(grid, x, y) == GC_EMPTY);
+	}
+	return result;
+}
+
+/* locks down a tetrimino, making it part of the grid */
+void lockdown(struct tetris_grid *grid, const struct tetrimino piece) {
+	for (size_t i=0; i<4; ++i) {
+		int x = (piece.minos[i].x + piece.pos_x);
+		int y = (piece.minos[i].y + piece.pos_y);
+		tg_setcell(grid, x, y, GC_FILL1);
+	}
+}
+
+void lockdown_colors(struct tetris_colors *colors, const struct tetrimino piece) {
+	for (size_t i=0; i<4; ++i) {
+		int x = (piece.minos[i].x + piece.pos_x);
+		int y = (piece.minos[i].y + piece.pos_y);
+		tc_setcell(colors, x, y, piece.type + 1);
+	}
+}
+
+/* BATCHED PLACEMENT TESTS
+ *
+ * every piece in every rotation is precomputed as up to 4 row masks, bottom
+ * row first, relative to its lowest and leftmost mino. the grid is copied
+ * into 32 bit rows with PLACEMENT_PAD full rows below and above it and the
+ * bits either side of it set, so walls, floor and ceiling are ordinary
+ * collisions and a candidate costs 4 shifts, 4 ANDs and a compare.
+ */
+
+/* the number of guard bits and rows around the padded grid */
+#define PLACEMENT_PAD 4
+/* the number of rows in the padded grid */
+#define PLACEMENT_ROWS (GRID_HEIGHT + 2 * PLACEMENT_PAD)
+/* the highest shift a shape's mask can take and stay inside 32 bits */
+#define PLACEMENT_MAX_COL (32 - 4)
+/* the highest padded row a shape's bottom row can start on */
+#define PLACEMENT_MAX_ROW (PLACEMENT_ROWS - 4)
+/* the number of (type, rotation) shapes */
+#define PLACEMENT_SHAPES (7 * 4)
+
+/* shape row masks, laid out by row so that each row can be gathered */
+static uint32_t shape_rows[4][PLACEMENT_SHAPES];
+/* the offset of the lowest and leftmost minos from a shape's origin */
+static int32_t shape_min_x[PLACEMENT_SHAPES], shape_min_y[PLACEMENT_SHAPES];
+static pthread_once_t shapes_once = PTHREAD_ONCE_INIT;
+
+typedef void (*placement_kernel)(const uint32_t *padded, const struct placement *, size_t, uint64_t *);
+static placement_kernel kernel;
+
+static void build_shapes();
+
+/* the shape index of a placement */
+static inline int shape_index(const struct placement *c) {
+	return c->type * 4 + c->rs;
+}
+
+/* copy the grid into padded form */
+static void pad_grid(const struct tetris_grid *grid, uint32_t *padded) {
+	const uint32_t walls = ~((uint32_t) GRID_FULL_ROW << PLACEMENT_PAD);
+	for (int row = 0; row < PLACEMENT_PAD; ++row) {
+		padded[row] = UINT32_MAX;
+		padded[PLACEMENT_ROWS - 1 - row] = UINT32_MAX;
+	}
+	for (int row = 0; row < GRID_HEIGHT; ++row) {
+		padded[row + PLACEMENT_PAD] = ((uint32_t) grid->rows[row] << PLACEMENT_PAD) | walls;
+	}
+}
+
+static bool placement_fits(const uint32_t *padded, const struct placement *c) {
+	int shape = shape_index(c);
+	int col = c->x + shape_min_x[shape] + PLACEMENT_PAD;
+	int row = c->y + shape_min_y[shape] + PLACEMENT_PAD;
+	if (col < 0 || col > PLACEMENT_MAX_COL || row < 0 || row > PLACEMENT_MAX_ROW) {
+		return false;
+	}
+	uint32_t hit = 0;
+	for (int r = 0; r < 4; ++r) {
+		hit |= (shape_rows[r][shape] << col) & padded[row + r];
+	}
+	return hit == 0;
+}
+
+/* test candidates first..n-1 one at a time */
+static void placements_range(const uint32_t *padded, const struct placement *candidates, size_t first, size_t n, uint64_t *mask) {
+	for (size_t i = first; i < n; ++i) {
+		if (placement_fits(padded, &candidates[i])) {
+			mask[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+}
+
+static void valid_placements_scalar(const uint32_t *padded, const struct placement *candidates, size_t n, uint64_t *mask) {
+	placements_range(padded, candidates, 0, n, mask);
+}
+
+#ifdef PLACEMENT_HAVE_AVX2
+/* eight candidates per iteration: the shapes and grid rows are gathered
+ * and shifted per lane, which SSE2 cannot do, so below AVX2 the scalar
+ * kernel is used */
+__attribute__((target("avx2")))
+static void valid_placements_avx2(const uint32_t *padded, const struct placement *candidates, size_t n, uint64_t *mask) {
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	const __m256i pad = _mm256_set1_epi32(PLACEMENT_PAD);
+	const __m256i below = _mm256_set1_epi32(-1);
+	const __m256i col_limit = _mm256_set1_epi32(PLACEMENT_MAX_COL + 1);
+	const __m256i row_limit = _mm256_set1_epi32(PLACEMENT_MAX_ROW + 1);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		/* struct placement is one little-endian int32: type, rs, x, y */
+		__m256i v = _mm256_loadu_si256((const __m256i *) (candidates + i));
+		__m256i type = _mm256_and_si256(v, byte);
+		__m256i rs = _mm256_and_si256(_mm256_srli_epi32(v, 8), byte);
+		__m256i x = _mm256_srai_epi32(_mm256_slli_epi32(v, 8), 24);
+		__m256i y = _mm256_srai_epi32(v, 24);
+		__m256i shape = _mm256_add_epi32(_mm256_slli_epi32(type, 2), rs);
+
+		__m256i col = _mm256_add_epi32(_mm256_add_epi32(x, pad), _mm256_i32gather_epi32(shape_min_x, shape, 4));
+		__m256i row = _mm256_add_epi32(_mm256_add_epi32(y, pad), _mm256_i32gather_epi32(shape_min_y, shape, 4));
+		__m256i ok = _mm256_and_si256(
+				_mm256_and_si256(_mm256_cmpgt_epi32(col, below), _mm256_cmpgt_epi32(col_limit, col)),
+				_mm256_and_si256(_mm256_cmpgt_epi32(row, below), _mm256_cmpgt_epi32(row_limit, row)));
+		/* out of range lanes look at row 0 column 0 and are masked off after */
+		col = _mm256_and_si256(col, ok);
+		row = _mm256_and_si256(row, ok);
+
+		__m256i hit = _mm256_setzero_si256();
+		for (int r = 0; r < 4; ++r) {
+			__m256i piece = _mm256_sllv_epi32(_mm256_i32gather_epi32((const int *) shape_rows[r], shape, 4), col);
+			__m256i cells = _mm256_i32gather_epi32((const int *) (padded + r), row, 4);
+			hit = _mm256_or_si256(hit, _mm256_and_si256(piece, cells));
+		}
+		__m256i valid = _mm256_and_si256(ok, _mm256_cmpeq_epi32(hit, _mm256_setzero_si256()));
+		uint64_t bits = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+		mask[i / 64] |= bits << (i % 64);
+	}
+	placements_range(padded, candidates, i, n, mask);
+}
+#endif
+
+/* build the shape table and pick the kernel for this cpu */
+static void build_shapes() {
+	for (int type = 0; type < 7; ++type) {
+		struct tetrimino piece = TETRIMINOS[type];
+		for (int rs = 0; rs < 4; ++rs, piece = tet_rotate_cw(piece)) {
+			int shape = type * 4 + rs;
+			int min_x = piece.minos[0].x, min_y = piece.minos[0].y;
+			for (int i = 1; i < 4; ++i) {
+				if (piece.minos[i].x < min_x) { min_x = piece.minos[i].x; }
+				if (piece.minos[i].y < min_y) { min_y = piece.minos[i].y; }
+			}
+			shape_min_x[shape] = min_x;
+			shape_min_y[shape] = min_y;
+			for (int r = 0; r < 4; ++r) {
+				shape_rows[r][shape] = 0;
+			}
+			for (int i = 0; i < 4; ++i) {
+				shape_rows[piece.minos[i].y - min_y][shape] |= 1u << (piece.minos[i].x - min_x);
+			}
+		}
+	}
+	kernel = valid_placements_scalar;
+#ifdef PLACEMENT_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		kernel = valid_placements_avx2;
+	}
+#endif
+}
+
+void valid_placements(const struct tetris_grid *grid, const struct placement *candidates, size_t n, uint64_t *mask) {
+	uint32_t padded[PLACEMENT_ROWS];
+	pthread_once(&shapes_once, build_shapes);
+	pad_grid(grid, padded);
+	memset(mask, 0, sizeof(uint64_t) * ((n + 63) / 64));
+	kernel(padded, candidates, n, mask);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "grid.h"
+#include "tetrimino.h"
+
+/* piece placement interface header */
+
+/* a candidate position for a piece, packed into 4 bytes so that a vector
+ * register holds a whole batch of them */
+struct placement {
+	/* the enum tetrimino_type and enum rotation_state of the piece */
+	uint8_t type, rs;
+	/* the position of the piece's origin on the grid */
+	int8_t x, y;
+};
+
+/* true if the piece is entirely on the grid and overlaps nothing */
+bool valid_placement(const struct tetris_grid *grid, const struct tetrimino piece);
+
+/* locks down a tetrimino, making it part of the grid */
+void lockdown(struct tetris_grid *grid, const struct tetrimino piece);
+
+/* records the cells a locked tetrimino covers as its colour */
+void lockdown_colors(struct tetris_colors *colors, const struct tetrimino piece);
+
+/**
+ * valid_placements
+ * tests n candidates at once, setting bit i % 64 of mask[i / 64] if
+ * candidate i is a valid placement and clearing it otherwise. mask must
+ * hold (n + 63) / 64 words. type and rs must be in range.
+ * uses AVX2 when the cpu has it and a scalar kernel otherwise
+ */
+void valid_placements(const struct tetris_grid *grid, const struct placement *candidates, size_t n, uint64_t *mask);
@@ -0,0 +1,137 @@
+#include <stdlib.h> /* malloc(), realloc() and free() */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h> /* strcmp() */
+
+#include "record.h"
+#include "event_queue.h"
+#include "grid.h"
+#include "state.h"
+
+struct recorder {
+	FILE *file;
+	/* the time of the first event, or -1 before it */
+	int64_t origin;
+};
+
+struct recorder * create_recorder(const char *path, unsigned int seed, int64_t das, int64_t arr) {
+	struct recorder *rec = (struct recorder *) malloc(sizeof(struct recorder));
+	if (rec == NULL) {
+		return NULL;
+	}
+	if ((rec->file = fopen(path, "w")) == NULL) {
+		free(rec);
+		return NULL;
+	}
+	rec->origin = -1;
+	fprintf(rec->file, "%s %d\nseed %u\nboard %d %d\nautoshift %" PRId64 " %" PRId64 "\n",
+			RECORD_MAGIC, RECORD_VERSION, seed, GRID_WIDTH, GRID_HEIGHT, das, arr);
+	return rec;
+}
+
+void destroy_recorder(struct recorder *rec) {
+	if (rec == NULL) {
+		return;
+	}
+	fclose(rec->file);
+	free(rec);
+}
+
+void record_event(struct recorder *rec, const struct game_event *event) {
+	if (rec->origin == -1) {
+		rec->origin = event->time;
+	}
+	fprintf(rec->file, "%" PRId64 " %s\n", event->time - rec->origin, ge_name(event->type));
+}
+
+void record_end(struct recorder *rec, const struct game_state *state) {
+	fprintf(rec->file, "end %" PRId64 " %016" PRIx64 "\n",
+			game_lines_cleared(state), record_grid_hash(game_grid(state)));
+}
+
+uint64_t record_grid_hash(const struct tetris_grid *grid) {
+	/* FNV-1a over the row masks */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int row = 0; row < GRID_HEIGHT; ++row) {
+		hash = (hash ^ grid->rows[row]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* the event type with the given name, or -1 if there is none */
+static int event_by_name(const char *name) {
+	for (int type = 0; ge_name((enum game_event_type) type) != NULL; ++type) {
+		if (strcmp(ge_name((enum game_event_type) type), name) == 0) {
+			return type;
+		}
+	}
+	return -1;
+}
+
+/* read a recording from file into rec, returns false on bad input */
+static bool parse_recording(FILE *file, struct recording *rec) {
+	char word[32];
+	int version;
+	if (fscanf(file, "%31s %d", word, &version) != 2 ||
+			strcmp(word, RECORD_MAGIC) != 0 || version < 1 || version > RECORD_VERSION ||
+			fscanf(file, " seed %u", &rec->seed) != 1) {
+		return false;
+	}
+	rec->width = 10;
+	rec->height = 40;
+	rec->das = GAME_DEFAULT_DAS;
+	rec->arr = GAME_DEFAULT_ARR;
+	if ((version >= 3 && fscanf(file, " board %d %d", &rec->width, &rec->height) != 2) ||
+			(version >= 2 && fscanf(file, " autoshift %" SCNd64 " %" SCNd64, &rec->das, &rec->arr) != 2)) {
+		return false;
+	}
+	size_t cap = 0;
+	while (fscanf(file, "%31s", word) == 1) {
+		if (strcmp(word, "end") == 0) {
+			rec->ended = fscanf(file, "%" SCNd64 " %" SCNx64, &rec->lines_cleared, &rec->grid_hash) == 2;
+			return rec->ended;
+		}
+		int64_t time;
+		if (sscanf(word, "%" SCNd64, &time) != 1 || fscanf(file, "%31s", word) != 1) {
+			return false;
+		}
+		int type = event_by_name(word);
+		if (type < 0) {
+			return false;
+		}
+		if (rec->count == cap) {
+			cap = cap > 0 ? cap * 2 : 256;
+			struct game_event *grown = (struct game_event *) realloc(rec->events, cap * sizeof(struct game_event));
+			if (grown == NULL) {
+				return false;
+			}
+			rec->events = grown;
+		}
+		rec->events[rec->count].type = (enum game_event_type) type;
+		rec->events[rec->count].time = time;
+		++rec->count;
+	}
+	return true;
+}
+
+struct recording * load_recording(const char *path) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return NULL;
+	}
+	struct recording *rec = (struct recording *) calloc(1, sizeof(struct recording));
+	if (rec != NULL && !parse_recording(file, rec)) {
+		destroy_recording(rec);
+		rec = NULL;
+	}
+	fclose(file);
+	return rec;
+}
+
+void destroy_recording(struct recording *rec) {
+	if (rec == NULL) {
+		return;
+	}
+	free(rec->events);
+	free(rec);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/* game recording interface header
+ *
+ * a recording is a text file holding the seed a game was dealt from, the
+ * size of its board and its auto shift timings, every event the game accepted with its time in
+ * nanoseconds since the first one, and a trailer with how the game ended.
+ * the engine only ever looks at differences between event times, so feeding
+ * the same events to a game with the same seed at the same offsets plays it
+ * out the same way, which the trailer lets a replay check.
+ *
+ *   termtris-replay 3
+ *   seed 1
+ *   board 10 40
+ *   autoshift 166666667 33333333
+ *   0 newgame
+ *   250000000 rshift
+ *   ...
+ *   end 12 9a3f00c2e1b5d774
+ */
+
+/* identifies a recording, followed by its format version */
+#define RECORD_MAGIC "termtris-replay"
+#define RECORD_VERSION 3
+
+struct game_event;
+struct game_state;
+struct tetris_grid;
+
+/* the writing side of a recording */
+struct recorder;
+
+/* start recording a game dealt from seed and played with the given DAS and
+ * ARR into path, returns NULL on failure */
+struct recorder * create_recorder(const char *path, unsigned int seed, int64_t das, int64_t arr);
+/* close the file, whether or not the game ended */
+void destroy_recorder(struct recorder *);
+
+/* add an event the game accepted. the first one sets the recording's origin */
+void record_event(struct recorder *, const struct game_event *event);
+
+/* write the trailer describing how the game ended */
+void record_end(struct recorder *, const struct game_state *state);
+
+/* a recording read back into memory */
+struct recording {
+	unsigned int seed;
+	/* the GRID_WIDTH and GRID_HEIGHT of the build that recorded it.
+	 * version 2 recordings, from before the board could change, are 10x40 */
+	int width, height;
+	/* the auto shift timings to play it with, see game_set_autoshift().
+	 * version 1 recordings, from before they could change, use the defaults */
+	int64_t das, arr;
+	/* the events, timed relative to the first */
+	struct game_event *events;
+	size_t count;
+	/* false if the recording stopped without a trailer */
+	bool ended;
+	/* how the game ended, if it did */
+	int64_t lines_cleared;
+	uint64_t grid_hash;
+};
+
+/* read the recording at path, returns NULL if it cannot be read or parsed */
+struct recording * load_recording(const char *path);
+void destroy_recording(struct recording *);
+
+/* a value summarising every cell of a grid, for comparing end states */
+uint64_t record_grid_hash(const struct tetris_grid *grid);
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h> /* memcpy() */
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* getopt() and close() */
+
+#include "tetrimino.h"
+#include "grid.h"
+#include "event_queue.h"
+#include "state.h"
+#include "display.h"
+#include "record.h"
+#include "bot.h"
+#include "dataset.h"
+
+/* replay plays recorded games back through the engine and the display
+ * backends, drawing to /dev/null, and checks that each ends the way it was
+ * recorded. it is the workload the profile-guided build trains on.
+ *
+ * with -x it also writes every placement of the recordings to a training
+ * dataset, see dataset.h. each recording is taken to be one game, and its
+ * placements carry the way it ended.
+ *
+ * with -r it instead records a game played by the autoplayer, for adding
+ * to the corpus.
+ *
+ * usage: replay [-n] [-x dataset_file] recording...
+ *        replay -r recording [-s seed] [-p max_pieces] [-d input_delay_ms]
+ */
+
+/* the time between frames, as game_loop() draws them */
+#define REPLAY_FRAME_NS 16666667L
+
+/* advance the game frame by frame from frame up to until, drawing each
+ * frame on disp unless it is NULL. returns the time of the last frame */
+static int64_t run_frames(struct game_state *state, struct display *disp, int64_t frame, int64_t until,
+		int64_t *frames) {
+	while (frame + REPLAY_FRAME_NS <= until) {
+		frame += REPLAY_FRAME_NS;
+		game_advance(state, frame);
+		if (disp != NULL) {
+			render_state(disp, state);
+		}
+		++*frames;
+	}
+	return frame;
+}
+
+/* the placements of the recording being exported, held until it ends */
+struct replay_export {
+	/* the display the game is drawn on, which is told about locks too */
+	struct display *disp;
+	struct dataset_writer *writer;
+	unsigned int seed;
+	struct dataset_record *records;
+	size_t count, capacity;
+};
+
+static void export_lock(void *ctx, const struct game_state *state, const struct tetrimino *piece, int lines) {
+	struct replay_export *export = (struct replay_export *) ctx;
+	if (export->disp != NULL) {
+		display_lock(export->disp, state, piece, lines);
+	}
+	if (export->count == export->capacity) {
+		export->capacity = export->capacity == 0 ? 256 : export->capacity * 2;
+		export->records = (struct dataset_record *) realloc(export->records, export->capacity * sizeof(struct dataset_record));
+		if (export->records == NULL) {
+			error(1, 0, "out of memory");
+		}
+	}
+	struct dataset_record *record = &export->records[export->count++];
+	/* the grid already holds the piece, the board it went on did not */
+	struct tetris_grid board = *game_grid(state);
+	for (int i = 0; i < 4; ++i) {
+		tg_setcell(&board, piece->minos[i].x + piece->pos_x, piece->minos[i].y + piece->pos_y, GC_EMPTY);
+	}
+	memcpy(record->board, board.rows, sizeof(record->board));
+	record->piece = (uint8_t) piece->type;
+	for (int i = 0; i < DATASET_NEXT; ++i) {
+		record->next[i] = (uint8_t) game_next(state, i);
+	}
+	record->placement = (struct placement) {
+		.type = (uint8_t) piece->type, .rs = (uint8_t) piece->rs,
+		.x = piece->pos_x, .y = piece->pos_y,
+	};
+	record->lines = (uint8_t) lines;
+	record->seed = export->seed;
+}
+
+/* write out the recording's placements now that it is known how it ended */
+static void export_end(struct replay_export *export, const struct game_state *state) {
+	for (size_t i = 0; i < export->count; ++i) {
+		export->records[i].game_lines = (uint32_t) game_lines_cleared(state);
+		export->records[i].topped_out = game_phase(state) == EP_GAMEOVER;
+		dataset_write(export->writer, &export->records[i]);
+	}
+	export->count = 0;
+}
+
+/* play a recording in a new game, passing its placements to export unless
+ * it is NULL. returns the game as it ends */
+static struct game_state * play_recording(const struct recording *rec, struct display *disp, int64_t *frames,
+		struct replay_export *export) {
+	struct game_state *state = create_game(rec->seed);
+	if (state == NULL) {
+		error(1, 0, "out of memory");
+	}
+	game_set_autoshift(state, rec->das, rec->arr);
+	if (export != NULL) {
+		export->seed = rec->seed;
+		export->disp = disp;
+		game_set_lock_observer(state, export_lock, export);
+	} else if (disp != NULL) {
+		game_set_lock_observer(state, display_lock, disp);
+	}
+	int64_t origin = game_now(state);
+	int64_t frame = origin;
+	for (size_t i = 0; i < rec->count && !game_exiting(state); ++i) {
+		struct game_event event = { .type = rec->events[i].type, .time = origin + rec->events[i].time };
+		frame = run_frames(state, disp, frame, event.time, frames);
+		game_advance(state, event.time);
+		game_push_event(state, event);
+	}
+	if (rec->count > 0) {
+		game_advance(state, origin + rec->events[rec->count - 1].time);
+	}
+	if (export != NULL) {
+		export_end(export, state);
+	}
+	return state;
+}
+
+/* the displays a recording is played through, each drawing to /dev/null */
+struct replay_displays {
+	struct display *ansi;
+#ifndef TERMTRIS_NO_CURSES
+	struct display *curses;
+	SCREEN *screen;
+	FILE *curses_in, *curses_out;
+#endif
+	int ansi_fd;
+};
+
+static void open_displays(struct replay_displays *displays) {
+	if ((displays->ansi_fd = open("/dev/null", O_WRONLY)) < 0) {
+		error(1, errno, "could not open /dev/null");
+	}
+	displays->ansi = create_ansi_display(-1, displays->ansi_fd, GRID_WIDTH, GRID_VISIBLE_HEIGHT);
+	if (displays->ansi == NULL) {
+		error(1, 0, "could not create the ANSI display");
+	}
+#ifndef TERMTRIS_NO_CURSES
+	displays->curses_in = fopen("/dev/null", "r");
+	displays->curses_out = fopen("/dev/null", "w");
+	if (displays->curses_in == NULL || displays->curses_out == NULL) {
+		error(1, errno, "could not open /dev/null");
+	}
+	/* a screen of the usual size, or tall enough for the board and its
+	 * borders, on a terminal type every system has */
+	char lines[16];
+	snprintf(lines, sizeof(lines), "%d", GRID_VISIBLE_HEIGHT + 2 > 24 ? GRID_VISIBLE_HEIGHT + 2 : 24);
+	setenv("LINES", lines, 1);
+	setenv("COLUMNS", "80", 1);
+	displays->screen = newterm("xterm", displays->curses_out, displays->curses_in);
+	if (displays->screen == NULL) {
+		error(1, 0, "could not start ncurses");
+	}
+	start_color();
+	init_pair(1, COLOR_RED, COLOR_BLUE);
+	init_pair(2, COLOR_WHITE, COLOR_BLACK);
+	init_piece_colors();
+	displays->curses = create_display(stdscr, GRID_WIDTH, GRID_VISIBLE_HEIGHT);
+	if (displays->curses == NULL) {
+		error(1, 0, "could not create the ncurses display");
+	}
+#endif
+}
+
+static void close_displays(struct replay_displays *displays) {
+	destroy_display(displays->ansi);
+	close(displays->ansi_fd);
+#ifndef TERMTRIS_NO_CURSES
+	destroy_display(displays->curses);
+	endwin();
+	delscreen(displays->screen);
+	fclose(displays->curses_in);
+	fclose(displays->curses_out);
+#endif
+}
+
+/* play a recording once per display, or once without one, exporting the
+ * first playback if export is not NULL. returns false if any playback
+ * ended differently from the recording */
+static bool replay_file(const char *path, struct replay_displays *displays, struct replay_export *export) {
+	struct recording *rec = load_recording(path);
+	if (rec == NULL) {
+		error(1, errno, "could not read %s", path);
+	}
+	if (rec->width != GRID_WIDTH || rec->height != GRID_HEIGHT) {
+		error(1, 0, "%s was recorded on a %dx%d board, this build plays %dx%d",
+				path, rec->width, rec->height, GRID_WIDTH, GRID_HEIGHT);
+	}
+	struct display *targets[2];
+	int target_count = 0;
+	if (displays == NULL) {
+		targets[target_count++] = NULL;
+	} else {
+		targets[target_count++] = displays->ansi;
+#ifndef TERMTRIS_NO_CURSES
+		targets[target_count++] = displays->curses;
+#endif
+	}
+
+	bool same = true;
+	for (int t = 0; t < target_count; ++t) {
+		int64_t frames = 0;
+		int64_t start = now64();
+		struct game_state *state = play_recording(rec, targets[t], &frames, t == 0 ? export : NULL);
+		double seconds = (now64() - start) / 1e9;
+		int64_t lines = game_lines_cleared(state);
+		uint64_t hash = record_grid_hash(game_grid(state));
+		bool match = !rec->ended || (lines == rec->lines_cleared && hash == rec->grid_hash);
+		fprintf(stderr, "%s: %zu events, %" PRId64 " frames, %" PRId64 " lines, %.3fs%s\n",
+				path, rec->count, frames, lines, seconds,
+				match ? "" : ", ended differently from the recording");
+		same = same && match;
+		destroy_game(state);
+	}
+	destroy_recording(rec);
+	return same;
+}
+
+/* queue the inputs that make a move, delay apart from after */
+static int plan_move(const struct move *move, int64_t after, int64_t delay, struct game_event *plan) {
+	int count = 0;
+	if (move->rotation == -1) {
+		plan[count++].type = GE_CCWROTATE;
+	}
+	for (int r = 0; r < move->rotation; ++r) {
+		plan[count++].type = GE_CWROTATE;
+	}
+	for (int s = 0; s < (move->shift < 0 ? -move->shift : move->shift); ++s) {
+		plan[count++].type = move->shift < 0 ? GE_LSHIFT : GE_RSHIFT;
+	}
+	plan[count++].type = GE_HARDDROP;
+	for (int i = 0; i < count; ++i) {
+		plan[i].time = after + (i + 1) * delay;
+	}
+	return count;
+}
+
+/* record the autoplayer playing a game with inputs delay apart. the bot
+ * plans from where the piece spawns, so with a long delay gravity gets in
+ * its way, which is fine: the recording is of whatever happened */
+static void record_bot_game(const char *path, unsigned int seed, int max_pieces, int64_t delay) {
+	struct game_state *state = create_game(seed);
+	if (state == NULL) {
+		error(1, 0, "out of memory");
+	}
+	struct recorder *rec = create_recorder(path, seed, game_das(state), game_arr(state));
+	if (rec == NULL) {
+		error(1, errno, "could not record to %s", path);
+	}
+	int64_t now = game_now(state);
+	struct game_event event = { .type = GE_NEWGAME, .time = now };
+	game_push_event(state, event);
+	record_event(rec, &event);
+
+	struct game_event plan[2 + GRID_WIDTH + 1];
+	int planned = 0, next = 0;
+	/* the grid the plan was made on, every lock changes it */
+	uint64_t planned_on = 0;
+	int pieces = 0;
+	while (pieces < max_pieces) {
+		game_advance(state, now);
+		if (game_phase(state) == EP_GAMEOVER) {
+			break;
+		}
+		const struct tetrimino *piece = game_piece(state);
+		uint64_t grid_hash = record_grid_hash(game_grid(state));
+		struct move move;
+		if (planned > 0 && grid_hash != planned_on) {
+			/* whatever was left of the plan was for a piece that has locked */
+			planned = next = 0;
+		}
+		if (piece != NULL && planned == 0 && bot_choose(game_grid(state), piece->type, &BOT_DEFAULT_WEIGHTS, &move)) {
+			planned = plan_move(&move, now, delay, plan);
+			planned_on = grid_hash;
+			next = 0;
+		}
+		if (next < planned && plan[next].time <= now) {
+			if (game_push_event(state, plan[next])) {
+				record_event(rec, &plan[next]);
+			}
+			if (plan[next].type == GE_HARDDROP) {
+				++pieces;
+			}
+			++next;
+			continue;
+		}
+		int64_t wake = game_next_event_time(state);
+		if (next < planned && (wake == -1 || plan[next].time < wake)) {
+			wake = plan[next].time;
+		}
+		if (wake == -1) {
+			break;
+		}
+		now = wake > now ? wake : now;
+	}
+
+	event.type = GE_QUIT;
+	event.time = now + delay;
+	game_advance(state, event.time);
+	game_push_event(state, event);
+	record_event(rec, &event);
+	game_advance(state, event.time);
+	record_end(rec, state);
+	fprintf(stderr, "%s: seed %u, %d pieces, %" PRId64 " lines\n", path, seed, pieces, game_lines_cleared(state));
+	destroy_game(state);
+	destroy_recorder(rec);
+}
+
+int main(int argc, char **argv) {
+	static const char usage[] = "usage: %s [-n] [-x dataset_file] recording... | %s -r recording [-s seed] [-p max_pieces] [-d input_delay_ms]";
+	bool draw = true;
+	const char *record_path = NULL;
+	const char *export_path = NULL;
+	unsigned int seed = 1;
+	int max_pieces = 200;
+	int delay_ms = 50;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "nx:r:s:p:d:")) != -1) {
+		switch (opt) {
+			case 'n':
+				draw = false;
+				break;
+			case 'x':
+				export_path = optarg;
+				break;
+			case 'r':
+				record_path = optarg;
+				break;
+			case 's':
+				seed = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				max_pieces = atoi(optarg);
+				break;
+			case 'd':
+				delay_ms = atoi(optarg);
+				break;
+			default:
+				error(1, 0, usage, argv[0], argv[0]);
+		}
+	}
+
+	if (record_path != NULL) {
+		if (delay_ms < 1) {
+			error(1, 0, "the input delay must be at least 1ms");
+		}
+		record_bot_game(record_path, seed, max_pieces, delay_ms * 1000000L);
+		return 0;
+	}
+	if (optind >= argc) {
+		error(1, 0, usage, argv[0], argv[0]);
+	}
+
+	struct dataset *dataset = NULL;
+	struct replay_export export = { 0 };
+	if (export_path != NULL) {
+		if ((dataset = create_dataset(export_path, 1)) == NULL) {
+			error(1, errno, "could not create %s", export_path);
+		}
+		if ((export.writer = create_dataset_writer(dataset)) == NULL) {
+			error(1, 0, "out of memory");
+		}
+	}
+	struct replay_displays displays;
+	if (draw) {
+		open_displays(&displays);
+	}
+	bool same = true;
+	for (int i = optind; i < argc; ++i) {
+		same = replay_file(argv[i], draw ? &displays : NULL, dataset != NULL ? &export : NULL) && same;
+	}
+	if (draw) {
+		close_displays(&displays);
+	}
+	if (dataset != NULL) {
+		destroy_dataset_writer(export.writer);
+		free(export.records);
+		if (!destroy_dataset(dataset)) {
+			error(1, errno, "could not write %s", export_path);
+		}
+	}
+	return same ? 0 : 1;
+}
@@ -0,0 +1,449 @@
+#define _GNU_SOURCE /* accept4() */
+#include <stdlib.h> /* malloc() and free() */
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h> /* strchr() and strcpy() */
+#include <errno.h>
+#include <error.h> /* error() */
+#include <signal.h> /* signal() */
+#include <unistd.h> /* read() and close() */
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h> /* sockaddr_un */
+#include <sys/resource.h> /* setrlimit() */
+#include <netinet/in.h> /* sockaddr_in */
+#include <arpa/inet.h> /* htons() */
+
+#include "server.h"
+#include "event_queue.h"
+#include "state.h"
+#include "wire.h"
+
+/* the most epoll events handled per wakeup */
+#define SERVER_EVENT_BATCH 256
+/* the most input bytes read from a client per wakeup */
+#define SERVER_READ_SIZE 64
+/* the games in each block a shard takes its sessions' games from */
+#define SERVER_POOL_GAMES 256
+
+/* one connected client and its game */
+struct session {
+	int fd;
+	struct game_state *game;
+	/* when the game next needs to be stepped, or -1 if never */
+	int64_t wake;
+	/* position in the shard's timer heap, or -1 if not scheduled */
+	int heap_index;
+	/* true while the socket is full and we wait for it to drain */
+	bool blocked;
+	/* the frame in flight, out_len bytes from out_off are still unsent */
+	uint8_t out[WIRE_KEYFRAME_SIZE];
+	size_t out_off, out_len;
+};
+
+/* one reactor thread and the sessions it owns */
+struct shard {
+	pthread_t thread;
+	int epoll_fd;
+	int listen_fd;
+	/* where session games are logged, or NULL */
+	struct event_log *log;
+	/* min-heap of sessions ordered by wake time, shared by all of them */
+	struct session **heap;
+	int heap_len, heap_cap;
+	/* the shard's games, in blocks so that the ones it steps sit together
+	 * rather than all over the heap, and a stack of those not in use */
+	struct game_pool **pools;
+	int pool_count;
+	struct game_state **idle;
+	int idle_len;
+};
+
+/* seeds handed out to new sessions so that games differ */
+static atomic_uint next_seed = 1;
+
+/* TIMER HEAP */
+
+static void heap_swap(struct shard *shard, int a, int b) {
+	struct session *tmp = shard->heap[a];
+	shard->heap[a] = shard->heap[b];
+	shard->heap[b] = tmp;
+	shard->heap[a]->heap_index = a;
+	shard->heap[b]->heap_index = b;
+}
+
+static void heap_sift_up(struct shard *shard, int i) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (shard->heap[parent]->wake <= shard->heap[i]->wake) {
+			break;
+		}
+		heap_swap(shard, i, parent);
+		i = parent;
+	}
+}
+
+static void heap_sift_down(struct shard *shard, int i) {
+	for (;;) {
+		int least = i;
+		int left = 2 * i + 1, right = 2 * i + 2;
+		if (left < shard->heap_len && shard->heap[left]->wake < shard->heap[least]->wake) {
+			least = left;
+		}
+		if (right < shard->heap_len && shard->heap[right]->wake < shard->heap[least]->wake) {
+			least = right;
+		}
+		if (least == i) {
+			break;
+		}
+		heap_swap(shard, i, least);
+		i = least;
+	}
+}
+
+static void heap_remove(struct shard *shard, struct session *session) {
+	int i = session->heap_index;
+	if (i < 0) {
+		return;
+	}
+	session->heap_index = -1;
+	if (--shard->heap_len == i) {
+		return;
+	}
+	shard->heap[i] = shard->heap[shard->heap_len];
+	shard->heap[i]->heap_index = i;
+	heap_sift_up(shard, i);
+	heap_sift_down(shard, i);
+}
+
+/* (re)schedule a session for the next event of its game */
+static void heap_schedule(struct shard *shard, struct session *session) {
+	int64_t wake = game_next_event_time(session->game);
+	if (wake == -1) {
+		heap_remove(shard, session);
+		return;
+	}
+	session->wake = wake;
+	if (session->heap_index < 0) {
+		if (shard->heap_len == shard->heap_cap) {
+			int cap = shard->heap_cap ? shard->heap_cap * 2 : 64;
+			struct session **heap = (struct session **) realloc(shard->heap, cap * sizeof(struct session *));
+			if (heap == NULL) {
+				error(1, errno, "could not grow the timer heap");
+			}
+			shard->heap = heap;
+			shard->heap_cap = cap;
+		}
+		session->heap_index = shard->heap_len++;
+		shard->heap[session->heap_index] = session;
+	}
+	heap_sift_up(shard, session->heap_index);
+	heap_sift_down(shard, session->heap_index);
+}
+
+/* GAMES */
+
+/* a game not in use, or NULL if out of memory */
+static struct game_state * shard_take_game(struct shard *shard) {
+	if (shard->idle_len == 0) {
+		/* every game is in use, add a block. the idle stack can then hold
+		 * every game the shard has, which it never needs more room than */
+		struct game_pool **pools = (struct game_pool **) realloc(shard->pools, (shard->pool_count + 1) * sizeof(struct game_pool *));
+		if (pools == NULL) {
+			return NULL;
+		}
+		shard->pools = pools;
+		struct game_state **idle = (struct game_state **) realloc(shard->idle,
+				(shard->pool_count + 1) * SERVER_POOL_GAMES * sizeof(struct game_state *));
+		if (idle == NULL) {
+			return NULL;
+		}
+		shard->idle = idle;
+		struct game_pool *pool = create_game_pool(SERVER_POOL_GAMES, 0);
+		if (pool == NULL) {
+			return NULL;
+		}
+		shard->pools[shard->pool_count++] = pool;
+		/* so that games are handed out from the start of the block */
+		for (int i = SERVER_POOL_GAMES - 1; i >= 0; --i) {
+			shard->idle[shard->idle_len++] = game_pool_get(pool, i);
+		}
+	}
+	return shard->idle[--shard->idle_len];
+}
+
+static void shard_return_game(struct shard *shard, struct game_state *game) {
+	shard->idle[shard->idle_len++] = game;
+}
+
+/* SESSIONS */
+
+/* deal the session's game afresh and start it */
+static void session_new_game(struct shard *shard, struct session *session) {
+	unsigned int seed = atomic_fetch_add(&next_seed, 1);
+	game_init(session->game, seed);
+	/* seeds are unique, so they double as the id in the log */
+	game_set_log(session->game, shard->log, seed);
+	struct game_event new_game = { .type = GE_NEWGAME, .time = now64() };
+	game_push_event(session->game, new_game);
+}
+
+static void session_close(struct shard *shard, struct session *session) {
+	heap_remove(shard, session);
+	close(session->fd); /* also removes it from the epoll set */
+	shard_return_game(shard, session->game);
+	free(session);
+}
+
+/* write out what is left of the frame in flight.
+ * returns false if the client is gone */
+static bool session_flush(struct session *session) {
+	while (session->out_len > 0) {
+		ssize_t sent = send(session->fd, session->out + session->out_off, session->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		session->out_off += sent;
+		session->out_len -= sent;
+	}
+	return true;
+}
+
+/* send the current frame. if the previous one is still in flight the new one
+ * is skipped: frames are whole snapshots, so a fresh one is sent once the
+ * socket drains. returns false if the client is gone */
+static bool session_send(struct shard *shard, struct session *session) {
+	if (!session_flush(session)) {
+		return false;
+	}
+	if (session->out_len == 0) {
+		struct game_frame frame;
+		frame_capture(&frame, session->game);
+		session->out_len = frame_encode(&frame, session->out);
+		session->out_off = 0;
+		if (!session_flush(session)) {
+			return false;
+		}
+	}
+	bool blocked = session->out_len > 0;
+	if (blocked != session->blocked) {
+		struct epoll_event ev = { .events = EPOLLIN | (blocked ? EPOLLOUT : 0), .data.ptr = session };
+		epoll_ctl(shard->epoll_fd, EPOLL_CTL_MOD, session->fd, &ev);
+		session->blocked = blocked;
+	}
+	return true;
+}
+
+static void session_open(struct shard *shard, int fd) {
+	struct session *session = (struct session *) malloc(sizeof(struct session));
+	if (session == NULL) {
+		close(fd);
+		return;
+	}
+	session->fd = fd;
+	session->heap_index = -1;
+	session->blocked = false;
+	session->out_off = session->out_len = 0;
+	if ((session->game = shard_take_game(shard)) == NULL) {
+		free(session);
+		close(fd);
+		return;
+	}
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = session };
+	if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		shard_return_game(shard, session->game);
+		free(session);
+		close(fd);
+		return;
+	}
+	session_new_game(shard, session);
+	heap_schedule(shard, session);
+}
+
+/* apply a batch of input, less what would change nothing */
+static void session_apply(struct session *session, struct game_event *events, size_t count) {
+	count = game_coalesce(session->game, events, count);
+	game_step_many(session->game, events, count);
+}
+
+/* apply whatever input the client sent. returns false if the session ended */
+static bool session_input(struct shard *shard, struct session *session) {
+	uint8_t buf[SERVER_READ_SIZE];
+	ssize_t len = read(session->fd, buf, sizeof(buf));
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		return false;
+	}
+	int64_t now = now64();
+	struct game_event events[SERVER_READ_SIZE];
+	size_t count = 0;
+	for (ssize_t i = 0; i < len; ++i) {
+		enum game_event_type type = (enum game_event_type) buf[i];
+		/* once its game is over a client may start another. what it sent
+		 * before that goes to the old game */
+		if (type == GE_NEWGAME) {
+			session_apply(session, events, count);
+			count = 0;
+			if (game_phase(session->game) == EP_GAMEOVER && !game_exiting(session->game)) {
+				session_new_game(shard, session);
+			}
+		}
+		/* otherwise only player input may come from outside the engine */
+		if (ge_is_input(type)) {
+			events[count].type = type;
+			events[count].time = now;
+			++count;
+		}
+	}
+	/* the rest of the read is applied at once */
+	session_apply(session, events, count);
+	game_advance(session->game, now);
+	if (game_exiting(session->game)) {
+		return false;
+	}
+	heap_schedule(shard, session);
+	return session_send(shard, session);
+}
+
+/* REACTOR */
+
+static void shard_accept(struct shard *shard) {
+	for (;;) {
+		int fd = accept4(shard->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			/* EAGAIN once another shard took it, or EMFILE under pressure */
+			return;
+		}
+		session_open(shard, fd);
+	}
+}
+
+/* step every session whose timer has expired */
+static void shard_expire(struct shard *shard) {
+	int64_t now = now64();
+	while (shard->heap_len > 0 && shard->heap[0]->wake <= now) {
+		struct session *session = shard->heap[0];
+		game_advance(session->game, now);
+		heap_schedule(shard, session);
+		if (!session_send(shard, session)) {
+			session_close(shard, session);
+		}
+	}
+}
+
+static void * shard_run(void *arg) {
+	struct shard *shard = (struct shard *) arg;
+	struct epoll_event events[SERVER_EVENT_BATCH];
+	for (;;) {
+		int timeout = -1;
+		if (shard->heap_len > 0) {
+			int64_t wait_ns = shard->heap[0]->wake - now64();
+			/* round up so we never wake before the deadline */
+			timeout = wait_ns <= 0 ? 0 : (int) ((wait_ns + 999999L) / 1000000L);
+		}
+		int n = epoll_wait(shard->epoll_fd, events, SERVER_EVENT_BATCH, timeout);
+		for (int i = 0; i < n; ++i) {
+			struct session *session = (struct session *) events[i].data.ptr;
+			if (session == NULL) {
+				shard_accept(shard);
+				continue;
+			}
+			bool alive = !(events[i].events & (EPOLLERR | EPOLLHUP));
+			if (alive && (events[i].events & EPOLLIN)) {
+				alive = session_input(shard, session);
+			} else if (alive && (events[i].events & EPOLLOUT)) {
+				alive = session_send(shard, session);
+			}
+			if (!alive) {
+				session_close(shard, session);
+			}
+		}
+		shard_expire(shard);
+	}
+	return NULL;
+}
+
+/* open a nonblocking listening socket for addr, or -1 on failure */
+static int server_listen(const char *addr) {
+	int fd;
+	if (strchr(addr, '/') != NULL) {
+		struct sockaddr_un sun = { .sun_family = AF_UNIX };
+		if (strlen(addr) >= sizeof(sun.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		strcpy(sun.sun_path, addr);
+		unlink(addr); /* left over from a previous run */
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *) &sun, sizeof(sun)) != 0) {
+			return -1;
+		}
+	} else {
+		struct sockaddr_in sin = {
+			.sin_family = AF_INET,
+			.sin_port = htons((uint16_t) atoi(addr)),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+		};
+		int on = 1;
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			return -1;
+		}
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0) {
+			return -1;
+		}
+	}
+	if (listen(fd, SOMAXCONN) != 0) {
+		return -1;
+	}
+	return fd;
+}
+
+int run_server(const char *addr, int threads, struct event_log *log) {
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	/* every session is a descriptor, so take as many as we are allowed */
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = server_listen(addr);
+	if (listen_fd < 0) {
+		error(0, errno, "could not listen on %s", addr);
+		return 1;
+	}
+
+	struct shard *shards = (struct shard *) calloc(threads, sizeof(struct shard));
+	if (shards == NULL) {
+		return 1;
+	}
+	for (int i = 0; i < threads; ++i) {
+		struct shard *shard = &shards[i];
+		shard->listen_fd = listen_fd;
+		shard->log = log;
+		if ((shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+			error(0, errno, "could not create reactor");
+			return 1;
+		}
+		/* every shard waits on the listener, but only one is woken per client */
+		struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+		if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
+			error(0, errno, "could not watch listener");
+			return 1;
+		}
+		if (pthread_create(&shard->thread, NULL, shard_run, shard) != 0) {
+			error(0, 0, "could not start reactor thread");
+			return 1;
+		}
+	}
+	for (int i = 0; i < threads; ++i) {
+		pthread_join(shards[i].thread, NULL);
+	}
+	return 0;
+}
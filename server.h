@@ -0,0 +1,17 @@
+#pragma once
+
+/* multi-session game server interface header */
+
+/**
+ * run_server
+ * hosts one game per connection on addr, which is either a path for a unix
+ * socket or a port number on the loopback interface. sessions are spread
+ * over the given number of reactor threads. clients send input as single
+ * game_event_type bytes and receive wire frames (see wire.h). once a game
+ * is over, GE_NEWGAME deals the session a new one.
+ * if log is not NULL every session's game is logged to it, under the seed
+ * it was dealt from, which is unique to the game.
+ * runs until the process is terminated, returns nonzero if it cannot start
+ */
+struct event_log;
+int run_server(const char *addr, int threads, struct event_log *log);
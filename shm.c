@@ -0,0 +1,121 @@
+#include <stdlib.h> /* malloc() and free() */
+#include <string.h> /* memset */
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* ftruncate() and close() */
+#include <sys/mman.h> /* mmap() and munmap() */
+
+#include "shm.h"
+#include "state.h"
+
+struct shm_link {
+	/* the mapped file */
+	struct shm_region *region;
+};
+
+struct shm_link * create_shm_link(const char *path) {
+	int fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(struct shm_region)) != 0) {
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, sizeof(struct shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); /* the mapping keeps the file alive */
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	struct shm_link *link = (struct shm_link *) malloc(sizeof(struct shm_link));
+	if (link == NULL) {
+		munmap(map, sizeof(struct shm_region));
+		return NULL;
+	}
+	link->region = (struct shm_region *) map;
+
+	/* a stale file from a previous run is reset wholesale */
+	memset(link->region, 0, sizeof(struct shm_region));
+	link->region->version = SHM_VERSION;
+	link->region->size = sizeof(struct shm_region);
+	/* readers check the magic last, so publish it last */
+	atomic_thread_fence(memory_order_release);
+	link->region->magic = SHM_MAGIC;
+	return link;
+}
+
+void destroy_shm_link(struct shm_link *link) {
+	if (link == NULL) {
+		return;
+	}
+	munmap(link->region, sizeof(struct shm_region));
+	free(link);
+}
+
+void shm_publish(struct shm_link *link, const struct game_state *state) {
+	struct shm_region *region = link->region;
+	struct shm_snapshot *snap = &region->state;
+	uint64_t seq = atomic_load_explicit(&region->seq, memory_order_relaxed);
+
+	/* enter the write side: the odd sequence number turns readers away */
+	atomic_store_explicit(&region->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	snap->grid = *game_grid(state);
+	const struct tetrimino *piece = game_piece(state);
+	snap->piece_active = piece != NULL;
+	if (piece != NULL) {
+		snap->piece = *piece;
+	}
+	snap->paused = game_paused(state);
+	snap->phase = (uint8_t) game_phase(state);
+	for (unsigned int i = 0; i < SHM_NEXT_COUNT; ++i) {
+		snap->next[i] = (uint8_t) game_next(state, i);
+	}
+	snap->level = game_level(state);
+	snap->lines_cleared = game_lines_cleared(state);
+	snap->now = game_now(state);
+
+	atomic_store_explicit(&region->seq, seq + 2, memory_order_release);
+}
+
+bool shm_poll(struct shm_link *link, struct game_event *evt, int64_t time) {
+	struct shm_region *region = link->region;
+	uint32_t tail = atomic_load_explicit(&region->input_tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&region->input_head, memory_order_acquire);
+	while (tail != head) {
+		uint8_t type = region->input[tail % SHM_INPUT_SLOTS];
+		++tail;
+		atomic_store_explicit(&region->input_tail, tail, memory_order_release);
+		/* only player input may come from outside the engine */
+		if (ge_is_input((enum game_event_type) type)) {
+			evt->type = (enum game_event_type) type;
+			evt->time = time;
+			return true;
+		}
+	}
+	return false;
+}
+
+void shm_read(const struct shm_region *region, struct shm_snapshot *out) {
+	uint64_t before, after;
+	do {
+		before = atomic_load_explicit(&region->seq, memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+		*out = region->state;
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&region->seq, memory_order_relaxed);
+	} while ((before & 1) || before != after);
+}
+
+bool shm_inject(struct shm_region *region, enum game_event_type type) {
+	uint32_t head = atomic_load_explicit(&region->input_head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&region->input_tail, memory_order_acquire);
+	if (head - tail >= SHM_INPUT_SLOTS) {
+		return false;
+	}
+	region->input[head % SHM_INPUT_SLOTS] = (uint8_t) type;
+	atomic_store_explicit(&region->input_head, head + 1, memory_order_release);
+	return true;
+}
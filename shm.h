@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#include "grid.h"
+#include "tetrimino.h"
+#include "event_queue.h"
+
+/* shared memory interface header
+ *
+ * the engine publishes its state into a memory-mapped file which external
+ * agents may map and read without going through the terminal. the state is
+ * guarded by a seqlock: the sequence number is odd while a write is in
+ * progress, and readers retry until they see the same even sequence number
+ * before and after copying the snapshot.
+ *
+ * agents feed moves back in through a single-producer single-consumer ring
+ * of game_event_type values, which the engine drains into its event queue.
+ */
+
+/* identifies a mapped file as a termtris state export ("tetrshm1") */
+#define SHM_MAGIC 0x316d687372746574ULL
+/* bumped whenever the layout below changes */
+#define SHM_VERSION 2
+/* the number of upcoming pieces published */
+#define SHM_NEXT_COUNT 5
+/* the number of slots in the input ring, must be a power of two */
+#define SHM_INPUT_SLOTS 64
+
+struct game_state;
+
+/* a consistent copy of the published game state */
+struct shm_snapshot {
+	/* the full play field */
+	struct tetris_grid grid;
+	/* the current piece, only meaningful when piece_active is set */
+	struct tetrimino piece;
+	uint8_t piece_active;
+	uint8_t paused;
+	/* the enum engine_phase the engine is in */
+	uint8_t phase;
+	/* the upcoming pieces, as enum tetrimino_type, in the order the bag
+	 * will deal them, see game_next() */
+	uint8_t next[SHM_NEXT_COUNT];
+	int64_t level;
+	int64_t lines_cleared;
+	/* the engine time of the most recently processed event */
+	int64_t now;
+};
+
+/* the layout of the shared file */
+struct shm_region {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t size;
+	/* odd while the engine is writing the snapshot */
+	_Atomic uint64_t seq;
+	struct shm_snapshot state;
+	/* the next slot the agent will write, only written by the agent */
+	_Alignas(64) _Atomic uint32_t input_head;
+	/* the next slot the engine will read, only written by the engine */
+	_Alignas(64) _Atomic uint32_t input_tail;
+	uint8_t input[SHM_INPUT_SLOTS];
+};
+
+/* engine side of a mapped region */
+struct shm_link;
+
+/* create (or reuse) and map the file at path, returns NULL on failure */
+struct shm_link * create_shm_link(const char *path);
+void destroy_shm_link(struct shm_link *);
+
+/* publish the current state of the game under the seqlock */
+void shm_publish(struct shm_link *, const struct game_state *);
+
+/**
+ * shm_poll
+ * takes the next event injected by an agent, stamped with the given time
+ * returns false if the input ring is empty
+ */
+bool shm_poll(struct shm_link *, struct game_event *evt, int64_t time);
+
+/* agent side helpers, usable on any mapping of the shared file */
+
+/* copy out a consistent snapshot, spinning while the engine writes */
+void shm_read(const struct shm_region *, struct shm_snapshot *out);
+
+/* queue an event for the engine, returns false if the ring is full */
+bool shm_inject(struct shm_region *, enum game_event_type type);
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE /* accept4() */
+#include <stdlib.h> /* malloc() and free() */
+#include <stdbool.h>
+#include <string.h> /* strlen() and memmove() */
+#include <errno.h>
+#include <unistd.h> /* close() and unlink() */
+#include <sys/socket.h>
+#include <sys/un.h> /* sockaddr_un */
+
+#include "spectate.h"
+#include "wire.h"
+#include "grid.h"
+#include "tetrimino.h"
+#include "state.h"
+#include "display.h"
+
+/* the most bytes a single encoded frame can take */
+#define SPECTATE_FRAME_MAX (WIRE_KEYFRAME_SIZE > WIRE_DELTA_MAX ? WIRE_KEYFRAME_SIZE : WIRE_DELTA_MAX)
+
+struct viewer {
+	int fd;
+	/* true until the viewer has a keyframe that the next delta applies to */
+	bool stale;
+	/* the frame in flight, out_len bytes from out_off are still unsent */
+	uint8_t out[SPECTATE_FRAME_MAX];
+	size_t out_off, out_len;
+};
+
+struct spectate_pub {
+	int listen_fd;
+	/* the most recently broadcast frame, which deltas are taken against */
+	struct game_frame last;
+	bool have_last;
+	/* the number of deltas since the last periodic keyframe */
+	unsigned int since_keyframe;
+	int viewer_count;
+	struct viewer viewers[SPECTATE_MAX_VIEWERS];
+};
+
+/* fill in a unix socket address, returns false if path is too long */
+static bool spectate_addr(struct sockaddr_un *sun, const char *path) {
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun->sun_path)) {
+		errno = ENAMETOOLONG;
+		return false;
+	}
+	strcpy(sun->sun_path, path);
+	return true;
+}
+
+struct spectate_pub * create_spectate_pub(const char *path) {
+	struct sockaddr_un sun;
+	if (!spectate_addr(&sun, path)) {
+		return NULL;
+	}
+	struct spectate_pub *pub = (struct spectate_pub *) malloc(sizeof(struct spectate_pub));
+	if (pub == NULL) {
+		return NULL;
+	}
+	pub->have_last = false;
+	pub->since_keyframe = 0;
+	pub->viewer_count = 0;
+	unlink(path); /* left over from a previous run */
+	pub->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (pub->listen_fd < 0 ||
+			bind(pub->listen_fd, (struct sockaddr *) &sun, sizeof(sun)) != 0 ||
+			listen(pub->listen_fd, SOMAXCONN) != 0) {
+		if (pub->listen_fd >= 0) {
+			close(pub->listen_fd);
+		}
+		free(pub);
+		return NULL;
+	}
+	return pub;
+}
+
+void destroy_spectate_pub(struct spectate_pub *pub) {
+	if (pub == NULL) {
+		return;
+	}
+	for (int i = 0; i < pub->viewer_count; ++i) {
+		close(pub->viewers[i].fd);
+	}
+	close(pub->listen_fd);
+	free(pub);
+}
+
+/* write out what is left of a viewer's frame in flight.
+ * returns false if the viewer is gone */
+static bool viewer_flush(struct viewer *viewer) {
+	while (viewer->out_len > 0) {
+		ssize_t sent = send(viewer->fd, viewer->out + viewer->out_off, viewer->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		viewer->out_off += sent;
+		viewer->out_len -= sent;
+	}
+	return true;
+}
+
+/* start sending an encoded frame, returns false if the viewer is gone */
+static bool viewer_send(struct viewer *viewer, const uint8_t *buf, size_t len) {
+	memcpy(viewer->out, buf, len);
+	viewer->out_off = 0;
+	viewer->out_len = len;
+	return viewer_flush(viewer);
+}
+
+void spectate_publish(struct spectate_pub *pub, const struct game_state *state) {
+	/* admit everyone waiting */
+	int fd;
+	while (pub->viewer_count < SPECTATE_MAX_VIEWERS &&
+			(fd = accept4(pub->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		struct viewer *viewer = &pub->viewers[pub->viewer_count++];
+		viewer->fd = fd;
+		viewer->stale = true;
+		viewer->out_off = viewer->out_len = 0;
+	}
+
+	struct game_frame frame;
+	frame_capture(&frame, state);
+
+	/* encode once for everybody */
+	uint8_t delta[WIRE_DELTA_MAX];
+	size_t delta_len = 0;
+	bool periodic = !pub->have_last;
+	if (pub->have_last) {
+		delta_len = frame_encode_delta(&pub->last, &frame, delta);
+		if (delta_len > 0 && ++pub->since_keyframe >= SPECTATE_KEYFRAME_INTERVAL) {
+			periodic = true;
+		}
+	}
+	uint8_t keyframe[WIRE_KEYFRAME_SIZE];
+	size_t keyframe_len = frame_encode(&frame, keyframe);
+	if (periodic) {
+		pub->since_keyframe = 0;
+	}
+	pub->last = frame;
+	pub->have_last = true;
+
+	for (int i = 0; i < pub->viewer_count; ++i) {
+		struct viewer *viewer = &pub->viewers[i];
+		bool alive = viewer_flush(viewer);
+		if (alive && viewer->out_len > 0) {
+			/* still behind: it misses this frame and resyncs later */
+			viewer->stale = true;
+		} else if (alive && (viewer->stale || periodic)) {
+			alive = viewer_send(viewer, keyframe, keyframe_len);
+			viewer->stale = false;
+		} else if (alive && delta_len > 0) {
+			alive = viewer_send(viewer, delta, delta_len);
+		}
+		if (!alive) {
+			close(viewer->fd);
+			*viewer = pub->viewers[--pub->viewer_count];
+			--i;
+		}
+	}
+}
+
+/* turn a decoded frame back into something render_state can draw */
+static void spectate_mirror(struct game_state *mirror, const struct game_frame *frame) {
+	struct tetris_grid grid;
+	struct tetrimino piece;
+	tg_clear(&grid);
+	for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+		grid.rows[row] = frame->rows[row] & GRID_FULL_ROW;
+	}
+	bool has_piece = frame_piece(frame, &piece);
+	game_mirror(mirror, &grid, has_piece ? &piece : NULL, (enum engine_phase) frame->phase,
+			frame->flags & WF_PAUSED, frame->level, frame->lines_cleared);
+}
+
+int spectate_view(const char *path, struct display *disp) {
+	struct sockaddr_un sun;
+	if (!spectate_addr(&sun, path)) {
+		return 1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return 1;
+	}
+	if (connect(fd, (struct sockaddr *) &sun, sizeof(sun)) != 0) {
+		/* the caller reports why connect() failed */
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return 1;
+	}
+	/* the mirror is only ever drawn, never stepped */
+	struct game_state *mirror = create_game(0);
+	if (mirror == NULL) {
+		close(fd);
+		return 1;
+	}
+
+	struct game_frame frame;
+	bool synced = false;
+	uint8_t buf[4096];
+	size_t len = 0;
+	for (;;) {
+		ssize_t got = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT);
+		if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			break;
+		}
+		if (got > 0) {
+			len += got;
+			size_t used = 0;
+			int n;
+			while ((n = frame_decode(&frame, buf + used, len - used)) > 0) {
+				/* deltas only make sense on top of a keyframe */
+				synced = synced || buf[used] == WIRE_KEYFRAME;
+				used += n;
+			}
+			if (n < 0) {
+				break;
+			}
+			memmove(buf, buf + used, len - used);
+			len -= used;
+			if (synced) {
+				spectate_mirror(mirror, &frame);
+				render_state(disp, mirror);
+			}
+		}
+		if (display_read_key(disp, 16) == 'q') {
+			break;
+		}
+	}
+	destroy_game(mirror);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+/* spectator stream interface header
+ *
+ * a publisher broadcasts one game to any number of viewers over a unix
+ * socket as a stream of wire frames. every viewer gets the same bytes, so
+ * the cost of a frame is paid once no matter how many are watching: deltas
+ * against the previous frame, with a keyframe every SPECTATE_KEYFRAME_INTERVAL
+ * frames and whenever a viewer joins or has fallen behind.
+ */
+
+/* the number of deltas between periodic keyframes */
+#define SPECTATE_KEYFRAME_INTERVAL 64
+/* the most viewers a publisher will accept */
+#define SPECTATE_MAX_VIEWERS 1024
+
+struct display;
+struct game_state;
+
+/* the broadcasting side of a spectator stream */
+struct spectate_pub;
+
+/* listen for viewers on the unix socket at path, returns NULL on failure */
+struct spectate_pub * create_spectate_pub(const char *path);
+void destroy_spectate_pub(struct spectate_pub *);
+
+/* admit waiting viewers and send them whatever changed since the last call */
+void spectate_publish(struct spectate_pub *, const struct game_state *);
+
+/* connect to the stream at path and render it on disp, reading keys from
+ * it too, until it ends or the viewer presses 'q'. any display will do,
+ * ncurses or ANSI. returns nonzero if the stream could not be opened */
+int spectate_view(const char *path, struct display *disp);
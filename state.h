@@ -3,9 +3,12 @@
 struct game_state;
 
 struct event_queue;
+struct game_event;
 struct tetris_grid;
 struct tetrimino;
 
+enum tetrimino_type;
+
 bool game_paused(const struct game_state *);
 const struct tetrimino * game_piece(const struct game_state *);
 const struct tetris_grid * game_grid(const struct game_state *);
@@ -32,3 +35,86 @@ enum engine_phase {
 	/* number of phases */
 	NUM_ENGINE_PHASES
 };
+
+enum engine_phase game_phase(const struct game_state *);
+int64_t game_now(const struct game_state *);
+/* the nth upcoming piece, 0 being the next one to spawn */
+enum tetrimino_type game_next(const struct game_state *, unsigned int n);
+bool game_exiting(const struct game_state *);
+
+/* the default delayed auto shift and auto repeat rate: 10 frames and 2 */
+#define GAME_DEFAULT_DAS 166666667L
+#define GAME_DEFAULT_ARR 33333333L
+/* the longest DAS or ARR a game can be set to, one second */
+#define GAME_MAX_AUTOSHIFT 1000000000L
+
+/**
+ * game_set_autoshift
+ * sets how long a held shift key waits before it repeats (das) and how
+ * long it waits between repeats (arr), in nanoseconds. an arr of 0 moves
+ * the piece all the way to the wall, and keeps it there while the key is held.
+ * both are clamped to 0..GAME_MAX_AUTOSHIFT
+ */
+void game_set_autoshift(struct game_state *, int64_t das, int64_t arr);
+int64_t game_das(const struct game_state *);
+int64_t game_arr(const struct game_state *);
+
+/* log every event the game steps and every phase it enters to log, under
+ * the given id. log may be NULL to stop logging */
+struct event_log;
+void game_set_log(struct game_state *, struct event_log *log, uint32_t id);
+
+/* called as each piece locks, while the grid holds it but not yet with
+ * the lines it completed cleared, which number lines */
+typedef void (*game_lock_observer)(void *ctx, const struct game_state *state, const struct tetrimino *piece, int lines);
+/* have observer called with ctx for every lock. observer may be NULL to stop */
+void game_set_lock_observer(struct game_state *, game_lock_observer observer, void *ctx);
+
+/* allocate a new game whose pieces are drawn from a bag seeded with seed */
+struct game_state * create_game(unsigned int seed);
+void destroy_game(struct game_state *);
+
+/* start a game over where it is, as create_game() would have made it.
+ * returns nonzero on failure */
+int game_init(struct game_state *, unsigned int seed);
+
+/* a dense block of games, seeded first_seed, first_seed+1.. for batch runs,
+ * or handed out again and again with game_init() by the server */
+struct game_pool;
+struct game_pool * create_game_pool(size_t count, unsigned int first_seed);
+void destroy_game_pool(struct game_pool *);
+struct game_state * game_pool_get(struct game_pool *, size_t i);
+size_t game_pool_size(const struct game_pool *);
+
+/* advance the game by processing one event */
+void game_step(struct game_state *, const struct game_event *event);
+/* schedule an event to be processed once its time comes.
+ * returns false, dropping the event, if too many are already pending */
+bool game_push_event(struct game_state *, struct game_event event);
+/* process every scheduled event due at or before now, returns the count */
+int game_advance(struct game_state *, int64_t now);
+/**
+ * game_step_many
+ * applies n input events in order, each after whatever was scheduled up to
+ * its time, as if each had been queued. unlike game_push_event() there is
+ * no limit on how many. the events must be in time order
+ * returns the number of steps taken, scheduled events included
+ */
+int game_step_many(struct game_state *, const struct game_event *events, size_t n);
+/**
+ * game_coalesce
+ * drops the events that would change nothing if applied in order with
+ * game_step_many(), such as shifts against a wall, keeping the rest in order
+ * returns the number kept
+ */
+size_t game_coalesce(const struct game_state *, struct game_event *events, size_t n);
+/* the time of the next scheduled event, or -1 if there is none */
+int64_t game_next_event_time(const struct game_state *);
+
+/* overwrite everything a display shows of a game, for mirroring a game
+ * that is played elsewhere. piece may be NULL if there is none */
+void game_mirror(struct game_state *, const struct tetris_grid *grid, const struct tetrimino *piece,
+		enum engine_phase phase, bool paused, int64_t level, int64_t lines_cleared);
+
+/* the current CLOCK_MONOTONIC time in nanoseconds */
+int64_t now64();
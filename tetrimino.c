@@ -1,62 +1,63 @@
 #include "tetrimino.h"
+#include "grid.h" /* where pieces spawn */
 
 /* the 7 tetrimino pieces, indexable by the tetrimino_type enum */
 const struct tetrimino TETRIMINOS[7] = {
 
-	/*TET_I*/{
+	/*TET_I*/[TT_I] = {
 		.minos = { {-1, 0}, {0, 0}, {1, 0}, {2, 0} },
 		.rs = RS_NORTH,
 		.type = TT_I,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_J*/{
+	/*TET_J*/[TT_J] = {
 		.minos = { {-1, 1}, {-1, 0}, {0, 0}, {1, 0} },
 		.rs = RS_NORTH,
 		.type = TT_J,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_L*/{
+	/*TET_L*/[TT_L] = {
 		.minos = { {1, 1}, {-1, 0}, {0, 0}, {1, 0} },
 		.rs = RS_NORTH,
 		.type = TT_L,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_O*/{
+	/*TET_O*/[TT_O] = {
 		.minos = { {0, 0}, {1, 0}, {0, 1}, {1, 1} },
 		.rs = RS_NORTH,
 		.type = TT_O,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_S*/{
+	/*TET_S*/[TT_S] = {
 		.minos = { {-1, 0}, {0, 0}, {0, 1}, {1, 1} },
 		.rs = RS_NORTH,
 		.type = TT_S,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_Z*/{
+	/*TET_Z*/[TT_Z] = {
 		.minos = { {-1, 1}, {0, 1}, {0, 0}, {1, 0} },
 		.rs = RS_NORTH,
 		.type = TT_Z,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	},
 
-	/*TET_T*/{
+	/*TET_T*/[TT_T] = {
 		.minos = { {0, 1}, {-1, 0}, {0, 0}, {1, 0} },
 		.rs = RS_NORTH,
 		.type = TT_T,
-		.pos_x = 4,
-		.pos_y = 20
+		.pos_x = GRID_SPAWN_X,
+		.pos_y = GRID_SPAWN_Y
 	}
 
 };
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <math.h>
+#include <error.h>
+#include <errno.h>
+#include <unistd.h> /* getopt() and sysconf() */
+#include <pthread.h>
+
+#include "bot.h"
+#include "state.h" /* now64() */
+
+/* tune searches for bot weights with the cross-entropy method: each
+ * generation samples candidate weights around a mean, plays every candidate
+ * on the same seeds, and refits the mean and spread to the best of them.
+ * games are played on a pool of threads, and progress is saved after every
+ * generation so that a run can be stopped and picked up again.
+ *
+ * usage: tune [-j threads] [-g generations] [-n population] [-e elite]
+ *             [-m games] [-p max_pieces] [-s first_seed] [-c checkpoint]
+ */
+
+/* identifies a checkpoint file, followed by its format version */
+#define TUNE_MAGIC "termtris-tune"
+#define TUNE_VERSION 2
+/* the spread the search starts with, in every weight */
+#define TUNE_INITIAL_SIGMA 0.5
+/* extra spread added each generation, divided by the generation number, so
+ * the search does not collapse onto the first elites it finds */
+#define TUNE_NOISE 0.1
+
+/* the search as saved between generations */
+struct tune_progress {
+	/* the games every candidate plays, which a run must keep to resume */
+	unsigned int first_seed;
+	int games, max_pieces;
+	int generation;
+	struct bot_weights mean, sigma;
+	/* the best candidate of the last generation and its average */
+	struct bot_weights best;
+	double best_lines;
+};
+
+/* one generation's games, shared by all threads */
+struct tune_job {
+	const struct bot_weights *candidates;
+	int population;
+	/* every candidate plays one game per seed */
+	const unsigned int *seeds;
+	int games;
+	int max_pieces;
+	/* lines[candidate * games + game] */
+	int64_t *lines;
+	/* the games handed out so far */
+	atomic_int next_game;
+	/* set to stop the workers at the next start */
+	bool done;
+	pthread_barrier_t start, finish;
+};
+
+static void * tune_worker(void *arg) {
+	struct tune_job *job = (struct tune_job *) arg;
+	for (;;) {
+		pthread_barrier_wait(&job->start);
+		if (job->done) {
+			return NULL;
+		}
+		int total = job->population * job->games;
+		int i;
+		while ((i = atomic_fetch_add(&job->next_game, 1)) < total) {
+			job->lines[i] = bot_play(&job->candidates[i / job->games], job->seeds[i % job->games], job->max_pieces);
+		}
+		pthread_barrier_wait(&job->finish);
+	}
+}
+
+/* splitmix64, enough for sampling candidates */
+static uint64_t tune_random(uint64_t *state) {
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* a standard normal sample, by Box-Muller */
+static double tune_gaussian(uint64_t *state) {
+	double u1 = ((tune_random(state) >> 11) + 1.0) / 9007199254740993.0;
+	double u2 = (tune_random(state) >> 11) / 9007199254740992.0;
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static int compare_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+	return (x > y) - (x < y);
+}
+
+/* orders candidate indices by their average, best first */
+static const double *sort_scores;
+static int compare_candidates(const void *a, const void *b) {
+	double x = sort_scores[*(const int *) a], y = sort_scores[*(const int *) b];
+	return (x < y) - (x > y);
+}
+
+static void print_weights(FILE *file, const char *label, const struct bot_weights *weights) {
+	fprintf(file, "%s", label);
+	for (int i = 0; i < BF_COUNT; ++i) {
+		fprintf(file, " %.17g", weights->w[i]);
+	}
+	fprintf(file, "\n");
+}
+
+static bool scan_weights(FILE *file, const char *label, struct bot_weights *weights) {
+	char found[16];
+	if (fscanf(file, "%15s", found) != 1 || strcmp(found, label) != 0) {
+		return false;
+	}
+	for (int i = 0; i < BF_COUNT; ++i) {
+		if (fscanf(file, "%lf", &weights->w[i]) != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* load a checkpoint, returns false if there is none. a checkpoint that
+ * cannot be read is fatal rather than silently starting over */
+static bool load_progress(const char *path, struct tune_progress *progress) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		if (errno == ENOENT) {
+			return false;
+		}
+		error(1, errno, "could not open %s", path);
+	}
+	char magic[32];
+	int version, features;
+	bool ok = fscanf(file, "%31s %d", magic, &version) == 2 &&
+		strcmp(magic, TUNE_MAGIC) == 0 && version == TUNE_VERSION &&
+		fscanf(file, " features %d", &features) == 1 && features == BF_COUNT &&
+		fscanf(file, " games %u %d %d", &progress->first_seed, &progress->games, &progress->max_pieces) == 3 &&
+		fscanf(file, " generation %d", &progress->generation) == 1 &&
+		scan_weights(file, "mean", &progress->mean) &&
+		scan_weights(file, "sigma", &progress->sigma) &&
+		scan_weights(file, "best", &progress->best) &&
+		fscanf(file, " best_lines %lf", &progress->best_lines) == 1;
+	fclose(file);
+	if (!ok) {
+		error(1, 0, "%s is not a checkpoint for this build", path);
+	}
+	return true;
+}
+
+/* save a checkpoint, replacing the old one only once the new one is written */
+static void save_progress(const char *path, const struct tune_progress *progress) {
+	char temp[4096];
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	FILE *file = fopen(temp, "w");
+	if (file == NULL) {
+		error(1, errno, "could not write %s", temp);
+	}
+	fprintf(file, "%s %d\n", TUNE_MAGIC, TUNE_VERSION);
+	fprintf(file, "features %d\n", BF_COUNT);
+	fprintf(file, "games %u %d %d\n", progress->first_seed, progress->games, progress->max_pieces);
+	fprintf(file, "generation %d\n", progress->generation);
+	print_weights(file, "mean", &progress->mean);
+	print_weights(file, "sigma", &progress->sigma);
+	print_weights(file, "best", &progress->best);
+	fprintf(file, "best_lines %.17g\n", progress->best_lines);
+	if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0) {
+		error(1, errno, "could not write %s", temp);
+	}
+	if (rename(temp, path) != 0) {
+		error(1, errno, "could not replace %s", path);
+	}
+}
+
+/* print the spread of one candidate's lines per game, sorting them */
+static void print_distribution(int64_t *lines, int games) {
+	qsort(lines, games, sizeof(int64_t), compare_int64);
+	printf("  lines/game: min %" PRId64 "  p10 %" PRId64 "  median %" PRId64 "  p90 %" PRId64 "  max %" PRId64 "\n",
+			lines[0], lines[games / 10], lines[games / 2], lines[games - 1 - games / 10], lines[games - 1]);
+}
+
+int main(int argc, char **argv) {
+	static const char usage[] = "usage: %s [-j threads] [-g generations] [-n population] [-e elite] "
+		"[-m games] [-p max_pieces] [-s first_seed] [-c checkpoint]";
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int generations = 20, population = 64, elite = 8, games = 32, max_pieces = 500;
+	unsigned int first_seed = 1;
+	const char *checkpoint = "tune.checkpoint";
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:g:n:e:m:p:s:c:")) != -1) {
+		switch (opt) {
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'g':
+				generations = atoi(optarg);
+				break;
+			case 'n':
+				population = atoi(optarg);
+				break;
+			case 'e':
+				elite = atoi(optarg);
+				break;
+			case 'm':
+				games = atoi(optarg);
+				break;
+			case 'p':
+				max_pieces = atoi(optarg);
+				break;
+			case 's':
+				first_seed = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				checkpoint = optarg;
+				break;
+			default:
+				error(1, 0, usage, argv[0]);
+		}
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (population < 2 || elite < 1 || elite > population || games < 1 || max_pieces < 1) {
+		error(1, 0, "need population >= 2, 1 <= elite <= population, games >= 1 and max_pieces >= 1");
+	}
+
+	struct tune_progress progress;
+	if (load_progress(checkpoint, &progress)) {
+		/* the averages of other games would not compare with the saved ones */
+		if (progress.first_seed != first_seed || progress.games != games || progress.max_pieces != max_pieces) {
+			error(1, 0, "%s was made with -s %u -m %d -p %d, resume it with those",
+					checkpoint, progress.first_seed, progress.games, progress.max_pieces);
+		}
+		printf("resuming %s at generation %d\n", checkpoint, progress.generation);
+	} else {
+		progress.first_seed = first_seed;
+		progress.games = games;
+		progress.max_pieces = max_pieces;
+		progress.generation = 0;
+		progress.mean = BOT_DEFAULT_WEIGHTS;
+		for (int i = 0; i < BF_COUNT; ++i) {
+			progress.sigma.w[i] = TUNE_INITIAL_SIGMA;
+		}
+		progress.best = progress.mean;
+		progress.best_lines = 0;
+	}
+
+	/* every candidate in every generation plays the same games, so that
+	 * differences in score come from the weights and not the deal */
+	unsigned int *seeds = (unsigned int *) malloc(sizeof(unsigned int) * games);
+	for (int i = 0; i < games; ++i) {
+		seeds[i] = first_seed + i;
+	}
+	struct bot_weights *candidates = (struct bot_weights *) malloc(sizeof(struct bot_weights) * population);
+	int64_t *lines = (int64_t *) malloc(sizeof(int64_t) * population * games);
+	double *scores = (double *) malloc(sizeof(double) * population);
+	int *order = (int *) malloc(sizeof(int) * population);
+	if (seeds == NULL || candidates == NULL || lines == NULL || scores == NULL || order == NULL) {
+		error(1, 0, "out of memory");
+	}
+
+	struct tune_job job = {
+		.candidates = candidates,
+		.population = population,
+		.seeds = seeds,
+		.games = games,
+		.max_pieces = max_pieces,
+		.lines = lines,
+		.done = false,
+	};
+	pthread_barrier_init(&job.start, NULL, threads + 1);
+	pthread_barrier_init(&job.finish, NULL, threads + 1);
+	pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+	for (int t = 0; t < threads; ++t) {
+		if (pthread_create(&workers[t], NULL, tune_worker, &job) != 0) {
+			error(1, 0, "could not start worker thread");
+		}
+	}
+
+	printf("%d threads, %d candidates x %d games of up to %d pieces, %d elite\n",
+			threads, population, games, max_pieces, elite);
+	for (int end = progress.generation + generations; progress.generation < end; ) {
+		/* seeded by generation so that a resumed run samples as an unbroken one would */
+		uint64_t random_state = ((uint64_t) first_seed << 32) ^ (uint64_t) progress.generation;
+		/* the mean itself is always a candidate, the rest are sampled around it */
+		candidates[0] = progress.mean;
+		for (int c = 1; c < population; ++c) {
+			for (int i = 0; i < BF_COUNT; ++i) {
+				candidates[c].w[i] = progress.mean.w[i] + progress.sigma.w[i] * tune_gaussian(&random_state);
+			}
+		}
+
+		int64_t start = now64();
+		atomic_store(&job.next_game, 0);
+		pthread_barrier_wait(&job.start);
+		pthread_barrier_wait(&job.finish);
+		double seconds = (now64() - start) / 1e9;
+
+		for (int c = 0; c < population; ++c) {
+			int64_t total = 0;
+			for (int g = 0; g < games; ++g) {
+				total += lines[c * games + g];
+			}
+			scores[c] = (double) total / games;
+			order[c] = c;
+		}
+		sort_scores = scores;
+		qsort(order, population, sizeof(int), compare_candidates);
+
+		/* refit to the elite */
+		++progress.generation;
+		for (int i = 0; i < BF_COUNT; ++i) {
+			double sum = 0, squares = 0;
+			for (int e = 0; e < elite; ++e) {
+				double w = candidates[order[e]].w[i];
+				sum += w;
+				squares += w * w;
+			}
+			double mean = sum / elite;
+			double variance = squares / elite - mean * mean;
+			progress.mean.w[i] = mean;
+			progress.sigma.w[i] = sqrt((variance > 0 ? variance : 0) + TUNE_NOISE / progress.generation);
+		}
+		progress.best = candidates[order[0]];
+		progress.best_lines = scores[order[0]];
+		save_progress(checkpoint, &progress);
+
+		printf("generation %d: %.1fs, %.0f games/s, best %.1f lines/game, old mean %.1f\n",
+				progress.generation, seconds, population * games / seconds,
+				scores[order[0]], scores[0]);
+		print_distribution(lines + order[0] * games, games);
+		print_weights(stdout, "  best", &progress.best);
+		fflush(stdout);
+	}
+
+	job.done = true;
+	pthread_barrier_wait(&job.start);
+	for (int t = 0; t < threads; ++t) {
+		pthread_join(workers[t], NULL);
+	}
+	pthread_barrier_destroy(&job.start);
+	pthread_barrier_destroy(&job.finish);
+	free(workers);
+	free(order);
+	free(scores);
+	free(lines);
+	free(candidates);
+	free(seeds);
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include "wire.h"
+#include "tetrimino.h"
+#include "state.h"
+
+void frame_capture(struct game_frame *frame, const struct game_state *state) {
+	const struct tetris_grid *grid = game_grid(state);
+	for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+		frame->rows[row] = grid->rows[row];
+	}
+	frame->phase = (uint8_t) game_phase(state);
+	frame->flags = game_paused(state) ? WF_PAUSED : 0;
+	const struct tetrimino *piece = game_piece(state);
+	if (piece != NULL) {
+		frame->flags |= WF_PIECE_ACTIVE;
+		frame->piece_type = (uint8_t) piece->type;
+		frame->piece_rs = (uint8_t) piece->rs;
+		frame->piece_x = piece->pos_x;
+		frame->piece_y = piece->pos_y;
+	} else {
+		frame->piece_type = frame->piece_rs = 0;
+		frame->piece_x = frame->piece_y = 0;
+	}
+	frame->level = (uint8_t) game_level(state);
+	frame->lines_cleared = (uint32_t) game_lines_cleared(state);
+}
+
+bool frame_piece(const struct game_frame *frame, struct tetrimino *out) {
+	if (!(frame->flags & WF_PIECE_ACTIVE) || frame->piece_type >= 7) {
+		return false;
+	}
+	*out = TETRIMINOS[frame->piece_type];
+	for (unsigned int i = 0; i < (frame->piece_rs & 3); ++i) {
+		*out = tet_rotate_cw(*out);
+	}
+	out->pos_x = frame->piece_x;
+	out->pos_y = frame->piece_y;
+	return true;
+}
+
+static uint8_t * put_header(const struct game_frame *frame, uint8_t *p) {
+	*p++ = frame->phase;
+	*p++ = frame->flags;
+	*p++ = (uint8_t) (frame->piece_type << 4 | (frame->piece_rs & 0xf));
+	*p++ = (uint8_t) frame->piece_x;
+	*p++ = (uint8_t) frame->piece_y;
+	*p++ = frame->level;
+	*p++ = (uint8_t) (frame->lines_cleared);
+	*p++ = (uint8_t) (frame->lines_cleared >> 8);
+	*p++ = (uint8_t) (frame->lines_cleared >> 16);
+	return p;
+}
+
+static const uint8_t * get_header(struct game_frame *frame, const uint8_t *p) {
+	frame->phase = *p++;
+	frame->flags = *p++;
+	frame->piece_type = *p >> 4;
+	frame->piece_rs = *p++ & 0xf;
+	frame->piece_x = (int8_t) *p++;
+	frame->piece_y = (int8_t) *p++;
+	frame->level = *p++;
+	frame->lines_cleared = p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16;
+	return p + 3;
+}
+
+static bool header_equal(const struct game_frame *a, const struct game_frame *b) {
+	return a->phase == b->phase && a->flags == b->flags &&
+		a->piece_type == b->piece_type && a->piece_rs == b->piece_rs &&
+		a->piece_x == b->piece_x && a->piece_y == b->piece_y &&
+		a->level == b->level &&
+		(a->lines_cleared & 0xffffff) == (b->lines_cleared & 0xffffff);
+}
+
+size_t frame_encode(const struct game_frame *frame, uint8_t *buf) {
+	uint8_t *p = buf;
+	*p++ = WIRE_KEYFRAME;
+	p = put_header(frame, p);
+	for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+		*p++ = (uint8_t) (frame->rows[row]);
+		*p++ = (uint8_t) (frame->rows[row] >> 8);
+	}
+	return p - buf;
+}
+
+size_t frame_encode_delta(const struct game_frame *prev, const struct game_frame *next, uint8_t *buf) {
+	uint64_t mask = 0;
+	for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+		if (prev->rows[row] != next->rows[row]) {
+			mask |= 1ULL << row;
+		}
+	}
+	if (!header_equal(prev, next)) {
+		mask |= WIRE_DELTA_HEADER;
+	}
+	if (mask == 0) {
+		return 0;
+	}
+	uint8_t *p = buf;
+	*p++ = WIRE_DELTA;
+	for (int i = 0; i < WIRE_MASK_SIZE; ++i) {
+		*p++ = (uint8_t) (mask >> (8 * i));
+	}
+	if (mask & WIRE_DELTA_HEADER) {
+		p = put_header(next, p);
+	}
+	for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+		if (mask & (1ULL << row)) {
+			*p++ = (uint8_t) (next->rows[row]);
+			*p++ = (uint8_t) (next->rows[row] >> 8);
+		}
+	}
+	return p - buf;
+}
+
+int frame_decode(struct game_frame *frame, const uint8_t *buf, size_t len) {
+	if (len == 0) {
+		return 0;
+	}
+	const uint8_t *p = buf + 1;
+	if (buf[0] == WIRE_KEYFRAME) {
+		if (len < WIRE_KEYFRAME_SIZE) {
+			return 0;
+		}
+		p = get_header(frame, p);
+		for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row, p += 2) {
+			frame->rows[row] = p[0] | p[1] << 8;
+		}
+		return p - buf;
+	} else if (buf[0] == WIRE_DELTA) {
+		if (len < 1 + WIRE_MASK_SIZE) {
+			return 0;
+		}
+		uint64_t mask = 0;
+		for (int i = 0; i < WIRE_MASK_SIZE; ++i) {
+			mask |= (uint64_t) *p++ << (8 * i);
+		}
+		size_t size = 1 + WIRE_MASK_SIZE + 2 * __builtin_popcountll(mask & ((1ULL << GRID_VISIBLE_HEIGHT) - 1)) +
+			((mask & WIRE_DELTA_HEADER) ? WIRE_HEADER_SIZE : 0);
+		if (len < size) {
+			return 0;
+		}
+		if (mask & WIRE_DELTA_HEADER) {
+			p = get_header(frame, p);
+		}
+		for (unsigned int row = 0; row < GRID_VISIBLE_HEIGHT; ++row) {
+			if (mask & (1ULL << row)) {
+				frame->rows[row] = p[0] | p[1] << 8;
+				p += 2;
+			}
+		}
+		return p - buf;
+	}
+	return -1;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "grid.h"
+
+/* wire protocol header
+ *
+ * a frame is everything a remote client needs to draw a game: the visible
+ * rows of the grid as bitmasks, the current piece and the counters. pieces
+ * are sent as their type, rotation and position since the minos can be
+ * rebuilt from TETRIMINOS.
+ *
+ * a stream of frames may instead carry deltas against the previous frame:
+ * a mask of the rows that changed, with a bit for the header fields, then
+ * only those parts. a keyframe must come first and may come again at any
+ * point to resynchronise.
+ *
+ * clients talk back with single bytes, each an input game_event_type, or
+ * GE_NEWGAME to start over once the game is over.
+ *
+ * the rows sent depend on the board the program was built for, so both
+ * ends must be builds for the same board.
+ */
+
+/* the leading byte of a full frame */
+#define WIRE_KEYFRAME 'K'
+/* the leading byte of a delta */
+#define WIRE_DELTA 'D'
+/* the encoded size of the non-row fields */
+#define WIRE_HEADER_SIZE 9
+/* the encoded size of a full frame */
+#define WIRE_KEYFRAME_SIZE (1 + WIRE_HEADER_SIZE + 2 * GRID_VISIBLE_HEIGHT)
+/* the bytes in a delta's row mask: a bit per visible row and one more */
+#define WIRE_MASK_SIZE ((GRID_VISIBLE_HEIGHT + 8) / 8)
+/* the encoded size of the largest possible delta */
+#define WIRE_DELTA_MAX (1 + WIRE_MASK_SIZE + WIRE_HEADER_SIZE + 2 * GRID_VISIBLE_HEIGHT)
+/* set in a delta's row mask, in its top bit, when the header fields follow */
+#define WIRE_DELTA_HEADER (1ULL << (8 * WIRE_MASK_SIZE - 1))
+
+static_assert(WIRE_MASK_SIZE <= 8, "a delta's row mask must fit in 64 bits");
+
+/* frame flags */
+#define WF_PAUSED 0x01
+#define WF_PIECE_ACTIVE 0x02
+
+struct game_state;
+struct tetrimino;
+
+struct game_frame {
+	/* bit n of a row is set if column n of that row is occupied */
+	uint16_t rows[GRID_VISIBLE_HEIGHT];
+	/* the enum engine_phase the engine is in */
+	uint8_t phase;
+	uint8_t flags;
+	/* the current piece, as enum tetrimino_type and enum rotation_state */
+	uint8_t piece_type, piece_rs;
+	int8_t piece_x, piece_y;
+	uint8_t level;
+	/* only the low 24 bits are sent */
+	uint32_t lines_cleared;
+};
+
+/* fill a frame from the current state of a game */
+void frame_capture(struct game_frame *, const struct game_state *);
+
+/* rebuild the piece described by a frame, returns false if there is none */
+bool frame_piece(const struct game_frame *, struct tetrimino *out);
+
+/* write a full frame to buf, which must hold WIRE_KEYFRAME_SIZE bytes.
+ * returns the number of bytes written */
+size_t frame_encode(const struct game_frame *, uint8_t *buf);
+
+/* write the changes from prev to next to buf, which must hold WIRE_DELTA_MAX
+ * bytes. returns the number of bytes written, 0 if nothing changed */
+size_t frame_encode_delta(const struct game_frame *prev, const struct game_frame *next, uint8_t *buf);
+
+/**
+ * frame_decode
+ * applies the keyframe or delta at the start of buf to frame
+ * returns the number of bytes consumed, 0 if buf holds only part of one,
+ * or -1 if buf does not start with a frame
+ */
+int frame_decode(struct game_frame *, const uint8_t *buf, size_t len);